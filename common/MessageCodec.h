@@ -0,0 +1,345 @@
+#ifndef MESSAGE_CODEC_H_
+#define MESSAGE_CODEC_H_
+
+/*
+ * Line protocol shared by esp_client, esp_server and the GUI.
+ *
+ * Every message is a single line: a one character tag followed by up to
+ * MAX_ARGS comma separated unsigned decimal arguments and a '\n'
+ * (e.g. "#42\n"). Lines that do not match an entry of MESSAGE_TABLE
+ * exactly are treated as free text and are just logged.
+ *
+ * Everything in here works on caller provided fixed size buffers and never
+ * touches the heap (tests/codec_fuzz.cpp checks this), so it is safe to call
+ * once per message on the ESP32. That only covers the codec: the sketches'
+ * message paths are allocation free, the GUI still allocates when it logs and
+ * displays a message.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace codec {
+
+    enum class MsgType : uint8_t {
+        None,          // empty line
+        SetCount,      // '#' count[,time[,seq]] where time is the event time in server millis() and
+                       //     seq numbers the events the server reports to the GUI
+        Increment,     // '+'
+        Decrement,     // '-'
+        ClientStarted, // 's' sent by a client after (re)connecting to WiFi
+        Reboot,        // 'r' sent by the server to request a client reboot
+        TimeRequest,   // 't' t0: clock sync request stamped with the requester's send time
+        TimeReply,     // 'T' t0,t1,t2: echoed t0, server receive time and server send time
+        Backfill,      // 'b' boot,seq: GUI asks for the events after seq (boot identifies the server run seq belongs to)
+        BackfillStart, // 'B' boot,first,last: server's run id and the range of seqs that follow
+        Config,        // 'c' key,value: sets a ConfigKey (GUI -> server) or reports its value (server -> GUI/client)
+        GetConfig,     // 'g': asks the server to report its ConfigKey values
+        Ack,           // 'a' version,boot[,seq]: server's reply to a client; version changes whenever a client setting changes,
+                       //     boot identifies the server run (a new one means its clock started over) and seq is the
+                       //     newest of the client's events the server has recorded (EventBatch only)
+        EventBatch,    // 'E' n,boot,first: the next n lines from a client are queued SetCount events numbered first,
+                       //     first + 1, ... by the client run identified by boot; n = 0 is a keepalive
+        Text,          // anything else
+    };
+
+    struct MsgSpec {
+        char tag;
+        MsgType type;
+        uint8_t minArgs;
+        uint8_t maxArgs;
+    };
+
+    constexpr size_t MAX_ARGS = 4;
+    // tag + MAX_ARGS * (10 digits + ',') + '\n'
+    constexpr size_t MAX_ENCODED_LEN = 1 + MAX_ARGS * 11 + 1;
+    // longest line accepted by LineReader (free text lines can be longer than encoded messages)
+    constexpr size_t MAX_LINE_LEN = 128;
+
+    constexpr MsgSpec MESSAGE_TABLE[] = {
+            {'#', MsgType::SetCount, 1, 3},
+            {'+', MsgType::Increment, 0, 0},
+            {'-', MsgType::Decrement, 0, 0},
+            {'s', MsgType::ClientStarted, 0, 0},
+            {'r', MsgType::Reboot, 0, 0},
+            {'t', MsgType::TimeRequest, 1, 1},
+            {'T', MsgType::TimeReply, 3, 3},
+            {'b', MsgType::Backfill, 2, 2},
+            {'B', MsgType::BackfillStart, 3, 3},
+            {'c', MsgType::Config, 2, 2},
+            {'g', MsgType::GetConfig, 0, 0},
+            {'a', MsgType::Ack, 2, 3},
+            {'E', MsgType::EventBatch, 3, 3},
+    };
+    // largest EventBatch a server accepts
+    constexpr uint32_t MAX_BATCH_EVENTS = 64;
+
+    constexpr size_t MESSAGE_TABLE_SIZE = sizeof(MESSAGE_TABLE) / sizeof(MESSAGE_TABLE[0]);
+
+    /*
+     * Runtime settings that can be changed from the GUI without reflashing.
+     * Server settings are applied by the server, client settings are relayed by
+     * the server to every station.
+     */
+    enum class ConfigKey : uint8_t {
+        ServerReadTimeoutS,   // how long the server waits for a client's line, kept below half its 5 s watchdog
+        ClientReadTimeoutS,   // how long a client waits for the server's reply
+        ClientSendIntervalMs, // minimum time between two sends from a client (0 = as fast as possible)
+        ClientBatchWindowMs,  // how long a client holds a new count so further changes go out with it
+        ClientConnectRetryMs, // initial delay between attempts to connect to the server
+        ClientWifiRetryMs,    // how long WiFi auto reconnect may try before the join is restarted (initial delay)
+        ClientBackoffMaxMs,   // the retry delays double after every failed attempt up to this
+        Count,
+    };
+
+    struct ConfigSpec {
+        ConfigKey key;
+        char const* name;
+        uint32_t minValue;
+        uint32_t maxValue;
+        uint32_t defaultValue;
+        bool isClient;
+    };
+
+    constexpr size_t CONFIG_KEY_COUNT = static_cast<size_t>(ConfigKey::Count);
+
+    // indexed by ConfigKey
+    constexpr ConfigSpec CONFIG_TABLE[] = {
+            {ConfigKey::ServerReadTimeoutS, "Server read timeout (s)", 1, 2, 2, false},
+            {ConfigKey::ClientReadTimeoutS, "Client read timeout (s)", 1, 10, 2, true},
+            {ConfigKey::ClientSendIntervalMs, "Client send interval (ms)", 0, 60000, 0, true},
+            {ConfigKey::ClientBatchWindowMs, "Client batch window (ms)", 0, 10000, 0, true},
+            {ConfigKey::ClientConnectRetryMs, "Client connect retry (ms)", 1, 10000, 10, true},
+            {ConfigKey::ClientWifiRetryMs, "Client WiFi rejoin timeout (ms)", 2000, 60000, 10000, true},
+            {ConfigKey::ClientBackoffMaxMs, "Client max retry backoff (ms)", 10, 60000, 8000, true},
+    };
+    static_assert(sizeof(CONFIG_TABLE) / sizeof(CONFIG_TABLE[0]) == CONFIG_KEY_COUNT, "CONFIG_TABLE must cover every ConfigKey");
+
+    /*
+     * Function:  find_config
+     * --------------------
+     * returns the table entry for a key received over the wire, nullptr if unknown
+     */
+    inline ConfigSpec const* find_config(uint32_t key) {
+        return key < CONFIG_KEY_COUNT ? &CONFIG_TABLE[key] : nullptr;
+    }
+
+    /*
+     * Function:  clamp_config
+     * --------------------
+     * returns value limited to the allowed range of spec
+     */
+    inline uint32_t clamp_config(ConfigSpec const& spec, uint32_t value) {
+        return value < spec.minValue ? spec.minValue : (value > spec.maxValue ? spec.maxValue : value);
+    }
+
+    struct Message {
+        MsgType type = MsgType::None;
+        uint8_t argc = 0;
+        uint32_t args[MAX_ARGS] = {};
+    };
+
+    inline Message make_message(MsgType type) {
+        Message m;
+        m.type = type;
+        return m;
+    }
+
+    inline Message make_message(MsgType type, uint32_t a0) {
+        Message m = make_message(type);
+        m.argc = 1;
+        m.args[0] = a0;
+        return m;
+    }
+
+    inline Message make_message(MsgType type, uint32_t a0, uint32_t a1) {
+        Message m = make_message(type, a0);
+        m.argc = 2;
+        m.args[1] = a1;
+        return m;
+    }
+
+    inline Message make_message(MsgType type, uint32_t a0, uint32_t a1, uint32_t a2) {
+        Message m = make_message(type, a0, a1);
+        m.argc = 3;
+        m.args[2] = a2;
+        return m;
+    }
+
+    /*
+     * Function:  find_spec
+     * --------------------
+     * looks up the table entry for a tag or a message type
+     *
+     * returns nullptr if there is no entry
+     */
+    inline MsgSpec const* find_spec(char tag) {
+        for (auto const& spec: MESSAGE_TABLE) {
+            if (spec.tag == tag) return &spec;
+        }
+        return nullptr;
+    }
+
+    inline MsgSpec const* find_spec(MsgType type) {
+        for (auto const& spec: MESSAGE_TABLE) {
+            if (spec.type == type) return &spec;
+        }
+        return nullptr;
+    }
+
+    /*
+     * Function:  encode_u32
+     * --------------------
+     * writes value as decimal ASCII (no terminator)
+     *
+     * returns number of characters written, 0 if it did not fit in cap
+     */
+    inline size_t encode_u32(uint32_t value, char* buf, size_t cap) {
+        char digits[10];
+        size_t n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        if (n > cap) return 0;
+        for (size_t i = 0; i < n; ++i) buf[i] = digits[n - 1 - i];
+        return n;
+    }
+
+    /*
+     * Function:  encode
+     * --------------------
+     * encodes msg, including the trailing '\n', into buf
+     *
+     * msg:  message to encode; Text messages cannot be encoded
+     * buf:  output buffer, MAX_ENCODED_LEN bytes is always enough
+     * cap:  size of buf
+     *
+     * returns length of the encoded line, 0 if msg is invalid or buf is too small
+     */
+    inline size_t encode(Message const& msg, char* buf, size_t cap) {
+        size_t len = 0;
+        if (msg.type != MsgType::None) {
+            MsgSpec const* spec = find_spec(msg.type);
+            if (spec == nullptr || msg.argc < spec->minArgs || msg.argc > spec->maxArgs) return 0;
+            if (cap < 1) return 0;
+            buf[len++] = spec->tag;
+            for (uint8_t i = 0; i < msg.argc; ++i) {
+                if (i > 0) {
+                    if (len >= cap) return 0;
+                    buf[len++] = ',';
+                }
+                size_t const n = encode_u32(msg.args[i], buf + len, cap - len);
+                if (n == 0) return 0;
+                len += n;
+            }
+        }
+        if (len >= cap) return 0;
+        buf[len++] = '\n';
+        return len;
+    }
+
+    /*
+     * Function:  decode
+     * --------------------
+     * decodes a single line; a trailing "\n" or "\r\n" is ignored
+     *
+     * line:  start of the line (does not have to be null terminated)
+     * len:   length of the line
+     * out:   decoded message; lines that do not strictly match a table entry
+     *        decode as MsgType::Text
+     *
+     * returns true if the line was a known message (or empty), false for Text
+     */
+    inline bool decode(char const* line, size_t len, Message& out) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) --len;
+        out = Message{};
+        if (len == 0) return true;
+
+        out.type = MsgType::Text;
+        MsgSpec const* spec = find_spec(line[0]);
+        if (spec == nullptr) return false;
+
+        Message m;
+        m.type = spec->type;
+        size_t i = 1;
+        while (i < len) {
+            if (m.argc == spec->maxArgs) return false;
+            uint32_t value = 0;
+            size_t const start = i;
+            for (; i < len && line[i] >= '0' && line[i] <= '9'; ++i) {
+                uint32_t const digit = static_cast<uint32_t>(line[i] - '0');
+                if (value > (UINT32_MAX - digit) / 10) return false;
+                value = value * 10 + digit;
+            }
+            if (i == start) return false;
+            m.args[m.argc++] = value;
+            if (i < len) {
+                if (line[i] != ',' || i + 1 == len) return false;
+                ++i;
+            }
+        }
+        if (m.argc < spec->minArgs) return false;
+
+        out = m;
+        return true;
+    }
+
+    /*
+     * Class:  LineReader
+     * --------------------
+     * assembles a byte stream into lines inside a fixed buffer
+     *
+     * lines longer than N are truncated to N characters, the rest of the line
+     * is dropped
+     */
+    template<size_t N = MAX_LINE_LEN>
+    class LineReader {
+    public:
+        /*
+         * pushes one byte, returns true once a full line is available through
+         * data()/size(); the line is discarded on the next push
+         */
+        bool push(char c) {
+            if (mComplete) {
+                mLen = 0;
+                mComplete = false;
+            }
+            if (c == '\n') {
+                mComplete = true;
+                return true;
+            }
+            if (c != '\r' && mLen < N) mBuf[mLen++] = c;
+            return false;
+        }
+
+        /*
+         * feeds a chunk of bytes and calls onLine(char const*, size_t) for
+         * every completed line
+         */
+        template<typename F>
+        void feed(char const* data, size_t len, F&& onLine) {
+            for (size_t i = 0; i < len; ++i) {
+                if (push(data[i])) onLine(mBuf, mLen);
+            }
+        }
+
+        void reset() {
+            mLen = 0;
+            mComplete = false;
+        }
+
+        char const* data() const { return mBuf; }
+        size_t size() const { return mLen; }
+        // bytes of a partial line received so far
+        size_t pending() const { return mComplete ? 0 : mLen; }
+
+    private:
+        char mBuf[N] = {};
+        size_t mLen = 0;
+        bool mComplete = false;
+    };
+
+} // namespace codec
+
+#endif /* MESSAGE_CODEC_H_ */
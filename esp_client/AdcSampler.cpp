@@ -0,0 +1,164 @@
+#include "AdcSampler.h"
+
+//the sensing loop must not use analogRead() while the DMA driver is running
+#if defined(ADC_SAMPLER_API_CONTINUOUS)
+
+#include "esp_adc/adc_continuous.h"
+#include "esp_attr.h"
+
+static adc_continuous_handle_t adc_handle = NULL;
+static volatile uint32_t overruns = 0;
+static uint8_t frame[ADC_SAMPLER_FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES];
+
+//called from ISR context by the driver when its pool is full
+static bool IRAM_ATTR on_pool_overflow(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *user_data)
+{
+  ++overruns;
+  return false;
+}
+
+bool adc_sampler_init(uint8_t pin, uint32_t sample_rate_hz)
+{
+  adc_unit_t unit;
+  adc_channel_t channel;
+  if (adc_continuous_io_to_channel(pin, &unit, &channel) != ESP_OK || unit != ADC_UNIT_1)
+    return false;
+
+  adc_continuous_handle_cfg_t handle_cfg = {};
+  handle_cfg.max_store_buf_size = sizeof(frame) * ADC_SAMPLER_POOL_FRAMES;
+  handle_cfg.conv_frame_size = sizeof(frame);
+  if (adc_continuous_new_handle(&handle_cfg, &adc_handle) != ESP_OK)
+  {
+    adc_handle = NULL;
+    return false;
+  }
+
+  adc_digi_pattern_config_t pattern = {};
+  pattern.atten = ADC_ATTEN_DB_12;
+  pattern.channel = channel & 0x7;
+  pattern.unit = unit;
+  pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+  adc_continuous_config_t dig_cfg = {};
+  dig_cfg.sample_freq_hz = sample_rate_hz;
+  dig_cfg.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  dig_cfg.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+  dig_cfg.pattern_num = 1;
+  dig_cfg.adc_pattern = &pattern;
+
+  adc_continuous_evt_cbs_t cbs = {};
+  cbs.on_pool_ovf = on_pool_overflow;
+  if (adc_continuous_config(adc_handle, &dig_cfg) != ESP_OK ||
+      adc_continuous_register_event_callbacks(adc_handle, &cbs, NULL) != ESP_OK ||
+      adc_continuous_start(adc_handle) != ESP_OK)
+  {
+    //adc_sampler_read() checks the handle, so a failed init leaves it NULL
+    adc_continuous_deinit(adc_handle);
+    adc_handle = NULL;
+    return false;
+  }
+  return true;
+}
+
+size_t adc_sampler_read(uint16_t *samples, size_t max_samples, uint32_t timeout_ms)
+{
+  if (adc_handle == NULL) return 0;
+  uint32_t bytes = 0;
+  if (adc_continuous_read(adc_handle, frame, sizeof(frame), &bytes, timeout_ms) != ESP_OK)
+    return 0;
+
+  size_t n = 0;
+  for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= bytes && n < max_samples; i += SOC_ADC_DIGI_RESULT_BYTES)
+  {
+    const adc_digi_output_data_t *p = (const adc_digi_output_data_t *) &frame[i];
+    samples[n++] = p->type1.data;
+  }
+  return n;
+}
+
+uint32_t adc_sampler_overruns()
+{
+  return overruns;
+}
+
+#elif defined(ADC_SAMPLER_API_DIGI)
+
+#include <Arduino.h>
+#include "driver/adc.h"
+#include "soc/soc_caps.h"
+
+static bool running = false;
+static uint32_t overruns = 0;
+static uint8_t frame[ADC_SAMPLER_FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES];
+
+bool adc_sampler_init(uint8_t pin, uint32_t sample_rate_hz)
+{
+  //ADC1 channels are 0-7, ADC2 channels (10 and up) are not available while WiFi is on
+  int8_t channel = digitalPinToAnalogChannel(pin);
+  if (channel < 0 || channel >= SOC_ADC_CHANNEL_NUM(0))
+    return false;
+
+  adc_digi_init_config_t init_cfg = {};
+  init_cfg.max_store_buf_size = sizeof(frame) * ADC_SAMPLER_POOL_FRAMES;
+  init_cfg.conv_num_each_intr = sizeof(frame);
+  init_cfg.adc1_chan_mask = BIT(channel);
+  init_cfg.adc2_chan_mask = 0;
+  if (adc_digi_initialize(&init_cfg) != ESP_OK)
+    return false;
+
+  adc_digi_pattern_config_t pattern = {};
+  pattern.atten = ADC_ATTEN_DB_11;
+  pattern.channel = channel;
+  pattern.unit = 0;//unit index, 0 is ADC1
+  pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+  adc_digi_configuration_t dig_cfg = {};
+  //the ESP32 needs a conversion limit in DMA mode, it is restarted after every conv_limit_num conversions
+  dig_cfg.conv_limit_en = 1;
+  dig_cfg.conv_limit_num = 250;
+  dig_cfg.sample_freq_hz = sample_rate_hz;
+  dig_cfg.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  dig_cfg.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+  dig_cfg.pattern_num = 1;
+  dig_cfg.adc_pattern = &pattern;
+  if (adc_digi_controller_configure(&dig_cfg) != ESP_OK)
+  {
+    adc_digi_deinitialize();
+    return false;
+  }
+
+  running = adc_digi_start() == ESP_OK;
+  return running;
+}
+
+size_t adc_sampler_read(uint16_t *samples, size_t max_samples, uint32_t timeout_ms)
+{
+  if (!running) return 0;
+  uint32_t bytes = 0;
+  esp_err_t err = adc_digi_read_bytes(frame, sizeof(frame), &bytes, timeout_ms);
+  //ESP_ERR_INVALID_STATE means the driver's pool overflowed, the frame read is still valid
+  if (err == ESP_ERR_INVALID_STATE) ++overruns;
+  else if (err != ESP_OK) return 0;
+
+  size_t n = 0;
+  for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= bytes && n < max_samples; i += SOC_ADC_DIGI_RESULT_BYTES)
+  {
+    const adc_digi_output_data_t *p = (const adc_digi_output_data_t *) &frame[i];
+    samples[n++] = p->type1.data;
+  }
+  return n;
+}
+
+uint32_t adc_sampler_overruns()
+{
+  return overruns;
+}
+
+#else
+
+//no DMA driver on this core, esp_client.ino refuses to build with USE_ANALOG_SENSOR
+bool adc_sampler_init(uint8_t pin, uint32_t sample_rate_hz) { return false; }
+size_t adc_sampler_read(uint16_t *samples, size_t max_samples, uint32_t timeout_ms) { return 0; }
+uint32_t adc_sampler_overruns() { return 0; }
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef ADC_SAMPLER_H_
+#define ADC_SAMPLER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * DMA driver used by the sampler, picked from the core the sketch is built with:
+ *   ADC_SAMPLER_API_CONTINUOUS  adc_continuous_* (ESP-IDF 5, arduino-esp32 3.x)
+ *   ADC_SAMPLER_API_DIGI        adc_digi_* (ESP-IDF 4.4, arduino-esp32 2.x)
+ * older cores have no DMA driver for the ADC and ADC_SAMPLER_SUPPORTED is 0
+ */
+#if __has_include("esp_adc/adc_continuous.h")
+#define ADC_SAMPLER_API_CONTINUOUS
+#elif __has_include("esp_idf_version.h") && __has_include("driver/adc.h")
+#include "esp_idf_version.h"
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0)
+#define ADC_SAMPLER_API_DIGI
+#endif
+#endif
+
+#if defined(ADC_SAMPLER_API_CONTINUOUS) || defined(ADC_SAMPLER_API_DIGI)
+#define ADC_SAMPLER_SUPPORTED 1
+#else
+#define ADC_SAMPLER_SUPPORTED 0
+#endif
+
+//number of samples handed out per adc_sampler_read() call (one DMA frame)
+#define ADC_SAMPLER_FRAME_SAMPLES 256
+//number of DMA frames the driver can hold while the sensing loop is busy
+//(at least 2 so one frame is filled while the previous one is processed)
+#define ADC_SAMPLER_POOL_FRAMES 4
+
+/*
+ * Function:  adc_sampler_init
+ * --------------------
+ * configures the ADC in continuous (DMA) mode on a single pin and starts sampling
+ *
+ * pin:             GPIO of the analog sensor, must be an ADC1 pin (ADC2 is used by WiFi)
+ * sample_rate_hz:  sampling rate, e.g. 20000
+ *
+ * returns true on success
+ */
+bool adc_sampler_init(uint8_t pin, uint32_t sample_rate_hz);
+
+/*
+ * Function:  adc_sampler_read
+ * --------------------
+ * waits for the next DMA frame and copies its raw readings into samples
+ *
+ * samples:      output buffer, ADC_SAMPLER_FRAME_SAMPLES entries is always enough
+ * max_samples:  size of samples
+ * timeout_ms:   maximum time to wait for a frame
+ *
+ * returns the number of samples written, 0 on timeout
+ */
+size_t adc_sampler_read(uint16_t *samples, size_t max_samples, uint32_t timeout_ms);
+
+/*
+ * Function:  adc_sampler_overruns
+ * --------------------
+ * returns how many times the DMA pool was full and samples were dropped
+ * because the sensing loop did not keep up
+ */
+uint32_t adc_sampler_overruns();
+
+#endif /* ADC_SAMPLER_H_ */
@@ -0,0 +1,117 @@
+#ifndef CROSSING_DETECTOR_H_
+#define CROSSING_DETECTOR_H_
+
+/*
+ * Threshold/hysteresis crossing detector for analog break-beam and distance
+ * sensors. Only depends on the C++ standard headers so recorded sample traces
+ * can be replayed through it on the host.
+ *
+ * Samples are low-pass filtered with a fixed-point exponential moving average
+ *   f += (x - f) / 2^filter_shift
+ * and a crossing is reported every time the filtered signal enters the
+ * active region (f >= on_threshold) after having been back in the idle
+ * region (f <= off_threshold).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+//fractional bits used for the filter state
+#define CROSSING_DETECTOR_FRAC_BITS 8
+
+typedef struct crossing_detector
+{
+  int32_t filtered;      //filter state, Q(CROSSING_DETECTOR_FRAC_BITS)
+  int32_t on_threshold;  //Q(CROSSING_DETECTOR_FRAC_BITS)
+  int32_t off_threshold; //Q(CROSSING_DETECTOR_FRAC_BITS)
+  uint8_t filter_shift;
+  uint8_t invert;        //set for sensors whose reading drops when an object is present
+  uint8_t active;
+  uint8_t primed;        //filter has been seeded with the first sample
+} crossing_detector;
+
+/*
+ * Function:  crossing_detector_init
+ * --------------------
+ * initializes a detector
+ *
+ * d:             detector to initialize
+ * on_threshold:  raw sample value at which an object is considered present
+ * off_threshold: raw sample value at which the object is considered gone
+ * filter_shift:  EMA time constant in samples is roughly 2^filter_shift (0 disables filtering)
+ * invert:        non-zero if presence lowers the reading; thresholds are then
+ *                crossed downwards and on_threshold must be below off_threshold
+ */
+static inline void crossing_detector_init(crossing_detector *d, uint16_t on_threshold, uint16_t off_threshold,
+                                          uint8_t filter_shift, uint8_t invert)
+{
+  d->filtered = 0;
+  d->filter_shift = filter_shift;
+  d->invert = invert ? 1 : 0;
+  d->active = 0;
+  d->primed = 0;
+  //inverted sensors are handled by negating samples and thresholds, so the
+  //comparison below is always "higher means present"
+  int32_t const sign = d->invert ? -1 : 1;
+  d->on_threshold = sign * ((int32_t) on_threshold << CROSSING_DETECTOR_FRAC_BITS);
+  d->off_threshold = sign * ((int32_t) off_threshold << CROSSING_DETECTOR_FRAC_BITS);
+}
+
+/*
+ * Function:  crossing_detector_process
+ * --------------------
+ * runs a block of samples through the detector
+ *
+ * d:        detector
+ * samples:  raw ADC readings
+ * n:        number of samples
+ *
+ * returns the number of crossings detected in this block
+ */
+static inline uint32_t crossing_detector_process(crossing_detector *d, const uint16_t *samples, size_t n)
+{
+  uint32_t crossings = 0;
+  int32_t f = d->filtered;
+  uint8_t active = d->active;
+  int32_t const sign = d->invert ? -1 : 1;
+
+  if (!d->primed && n > 0)
+  {
+    //seed the filter so it does not ramp up from 0 and trigger on start-up
+    f = sign * ((int32_t) samples[0] << CROSSING_DETECTOR_FRAC_BITS);
+    active = f >= d->on_threshold;
+    d->primed = 1;
+  }
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    int32_t const x = sign * ((int32_t) samples[i] << CROSSING_DETECTOR_FRAC_BITS);
+    f += (x - f) >> d->filter_shift;
+    if (!active && f >= d->on_threshold)
+    {
+      active = 1;
+      ++crossings;
+    }
+    else if (active && f <= d->off_threshold)
+    {
+      active = 0;
+    }
+  }
+
+  d->filtered = f;
+  d->active = active;
+  return crossings;
+}
+
+/*
+ * Function:  crossing_detector_level
+ * --------------------
+ * returns the current filtered level in raw sample units
+ */
+static inline uint16_t crossing_detector_level(const crossing_detector *d)
+{
+  int32_t const f = d->invert ? -d->filtered : d->filtered;
+  return (uint16_t) (f >> CROSSING_DETECTOR_FRAC_BITS);
+}
+
+#endif /* CROSSING_DETECTOR_H_ */
@@ -0,0 +1,115 @@
+#ifndef EVENT_QUEUE_H_
+#define EVENT_QUEUE_H_
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+//number of count events kept while the server is unreachable, the oldest are dropped beyond this
+#define EVENT_QUEUE_SIZE 1024
+
+typedef struct count_event
+{
+  uint32_t count;    //count after the event
+  uint32_t time_ms;  //local millis() of the event
+} count_event;
+
+/*
+ * Bounded queue of count events from the sensing core to the WiFi task.
+ *
+ * head and tail are free running indices (slot = index % EVENT_QUEUE_SIZE), so
+ * the WiFi task can copy events out, try to deliver them and only remove them
+ * once the server has acknowledged them, even if the sensing core had to drop
+ * the oldest ones in the meantime.
+ */
+typedef struct event_queue
+{
+  count_event events[EVENT_QUEUE_SIZE];
+  uint32_t head;     //index the next event is written to
+  uint32_t tail;     //index of the oldest event not yet delivered
+  uint32_t dropped;  //events lost because the queue was full
+  SemaphoreHandle_t sem;
+} event_queue;
+
+/*
+ * Function:  event_queue_init
+ * --------------------
+ * initializes an empty queue
+ */
+static inline void event_queue_init(event_queue *q)
+{
+  q->head = 0;
+  q->tail = 0;
+  q->dropped = 0;
+  q->sem = xSemaphoreCreateMutex();
+}
+
+/*
+ * Function:  event_queue_push
+ * --------------------
+ * appends an event, dropping the oldest one if the queue is full
+ */
+static inline void event_queue_push(event_queue *q, uint32_t count, uint32_t time_ms)
+{
+  xSemaphoreTake(q->sem, portMAX_DELAY);
+  if (q->head - q->tail == EVENT_QUEUE_SIZE)
+  {
+    ++q->tail;
+    ++q->dropped;
+  }
+  count_event &e = q->events[q->head % EVENT_QUEUE_SIZE];
+  e.count = count;
+  e.time_ms = time_ms;
+  ++q->head;
+  xSemaphoreGive(q->sem);
+}
+
+/*
+ * Function:  event_queue_peek
+ * --------------------
+ * copies the oldest events without removing them
+ *
+ * out:    output buffer
+ * max:    size of out
+ * first:  set to the index of the first copied event, pass it to event_queue_commit()
+ *
+ * returns the number of events copied
+ */
+static inline uint32_t event_queue_peek(event_queue *q, count_event *out, uint32_t max, uint32_t *first)
+{
+  xSemaphoreTake(q->sem, portMAX_DELAY);
+  uint32_t n = q->head - q->tail;
+  if (n > max) n = max;
+  for (uint32_t i = 0; i < n; ++i) out[i] = q->events[(q->tail + i) % EVENT_QUEUE_SIZE];
+  *first = q->tail;
+  xSemaphoreGive(q->sem);
+  return n;
+}
+
+/*
+ * Function:  event_queue_commit
+ * --------------------
+ * removes events that were peeked and delivered; events dropped in the
+ * meantime are accounted for
+ */
+static inline void event_queue_commit(event_queue *q, uint32_t first, uint32_t n)
+{
+  xSemaphoreTake(q->sem, portMAX_DELAY);
+  if ((int32_t) (first + n - q->tail) > 0) q->tail = first + n;
+  xSemaphoreGive(q->sem);
+}
+
+/*
+ * Function:  event_queue_size
+ * --------------------
+ * returns the number of events waiting to be delivered
+ */
+static inline uint32_t event_queue_size(event_queue *q)
+{
+  xSemaphoreTake(q->sem, portMAX_DELAY);
+  uint32_t n = q->head - q->tail;
+  xSemaphoreGive(q->sem);
+  return n;
+}
+
+#endif /* EVENT_QUEUE_H_ */
@@ -14,34 +14,127 @@ static const char* password = STAPSK;
 
 static const char* host = "192.168.4.1";//observed to be default IP of server ESP
 static const uint16_t port = 80;
-static WiFiMulti multi;
 
 //used to share data between cores
-extern volatile shared_uint32 x;
+extern event_queue events;
+
+//clock sync state, server time ~= local millis() + clock_offset
+static clock_sample clock_samples[CLOCK_SYNC_SAMPLES];
+static uint32_t clock_sample_idx = 0;
+static int32_t clock_offset = 0;
+static bool clock_synced = false;
+static uint32_t last_sync_ms = 0;
+static uint32_t server_boot = 0;//run of the server the clock samples belong to
+static bool server_boot_known = false;
+
+//runtime settings relayed by the server (see codec::CONFIG_TABLE)
+static uint32_t config[codec::CONFIG_KEY_COUNT];
+static uint32_t config_version = 0;
+static bool config_stale = true;//fetch the server's settings before the first count
+
+//connection state machine
+static link_state current_link = LINK_WIFI_DOWN;
+static uint32_t retry_delay_ms = 0;//current backoff, doubles after every failed attempt
+static uint32_t last_attempt_ms = 0;
+//the server is told "client started" after a boot or WiFi rejoin, which also confirms a requested reboot;
+//after other failures we must not send it, since that would cancel a reboot request meant for us
+static bool announce_start = true;
+
+//identifies this run to the server, which numbers our events by their queue index within it
+static uint32_t boot_id = 0;
+static uint32_t last_send_ms = 0;
 
 //like setup() and loop(), but run on the other core
 
 void setup1()
 {
-  wireless_init();//init WiFi hardware and connect to network
+  for (size_t i = 0; i < codec::CONFIG_KEY_COUNT; ++i) config[i] = codec::CONFIG_TABLE[i].defaultValue;
+  boot_id = esp_random();
+  wireless_init();//init WiFi hardware and start connecting to the network
 }
 
-//example code, this will update the server as fast as it can. You can add a rest(x) call to delay by x ms
+//runs the connection state machine; nothing in here waits for the network for longer than one
+//connection attempt, and the sensing core keeps queueing events regardless of what happens here
 void loop1()
 {
-  static uint32_t shared_val = 0;
-  //minimized time spend holding semaphore
-  LOCK_SHARED_VARIABLE(x);
-  shared_val = x.value;
-  UNLOCK_SHARED_VARIABLE(x);
-  
-  update_count(shared_val);
+  uint32_t now = millis();
+  switch (current_link)
+  {
+    case LINK_WIFI_DOWN:
+      if (WiFi.status() == WL_CONNECTED)
+      {
+        #ifdef ENABLE_SERIAL_DEBUG_OUTPUTS
+          Serial.print("WiFi connection successful with IP ");
+          Serial.println(WiFi.localIP());
+        #endif
+        announce_start = true;
+        enter_state(LINK_SERVER_DOWN);
+      }
+      else if (now - last_attempt_ms >= retry_delay_ms)
+      {
+        //auto reconnect does the rejoining, this only restarts a join that seems stuck
+        #ifdef ENABLE_SERIAL_DEBUG_OUTPUTS
+          Serial.println("Restarting WiFi join");
+        #endif
+        WiFi.reconnect();
+        back_off(codec::ConfigKey::ClientWifiRetryMs);
+      }
+      break;
+
+    case LINK_SERVER_DOWN:
+      if (WiFi.status() != WL_CONNECTED) enter_state(LINK_WIFI_DOWN);
+      else if (now - last_attempt_ms >= retry_delay_ms)
+      {
+        bool ok = announce_start ? send_simple(codec::make_message(codec::MsgType::ClientStarted)) : flush_events(0);
+        if (ok)
+        {
+          announce_start = false;
+          enter_state(LINK_ONLINE);
+        }
+        else back_off(codec::ConfigKey::ClientConnectRetryMs);
+      }
+      break;
+
+    case LINK_ONLINE:
+      if (!service_server(now))
+        enter_state(WiFi.status() == WL_CONNECTED ? LINK_SERVER_DOWN : LINK_WIFI_DOWN);
+      break;
+  }
+  rest(1);
+}
+
+static uint32_t setting(codec::ConfigKey key)
+{
+  return config[(size_t) key];
+}
+
+static void enter_state(link_state next)
+{
+  #ifdef ENABLE_SERIAL_DEBUG_OUTPUTS
+    if (next != LINK_ONLINE) Serial.println(next == LINK_WIFI_DOWN ? "WiFi disconnected" : "Connection to server failed");
+  #endif
+  current_link = next;
+  //the server may restart while we cannot reach it
+  if (next == LINK_SERVER_DOWN) reset_clock();
+  //first attempt to reach the server is made right away; WiFi is rejoined by the core's auto
+  //reconnect, which must get enough time to associate before the join is restarted
+  retry_delay_ms = next == LINK_WIFI_DOWN ? setting(codec::ConfigKey::ClientWifiRetryMs) : 0;
+  last_attempt_ms = millis();
+}
+
+static void back_off(codec::ConfigKey initial)
+{
+  uint32_t max_delay = setting(codec::ConfigKey::ClientBackoffMaxMs);
+  if (max_delay < setting(initial)) max_delay = setting(initial);
+  retry_delay_ms = retry_delay_ms == 0 ? setting(initial) : retry_delay_ms * 2;
+  if (retry_delay_ms > max_delay) retry_delay_ms = max_delay;
+  last_attempt_ms = millis();
 }
 
 /*
  * Function:  wireless_init
  * --------------------
- * initializes and connects to WiFi
+ * initializes WiFi and starts connecting, loop1() picks up from there
  */
 static void wireless_init()
 {
@@ -52,95 +145,211 @@ static void wireless_init()
     Serial.print("Connecting to ");
     Serial.println(ssid);
   #endif
-  // We start by connecting to a WiFi network
-  multi.addAP(ssid, password);
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(true);//the core rejoins on its own after a disconnect
+  WiFi.begin(ssid, password);
+  enter_state(LINK_WIFI_DOWN);
+}
+
+static bool service_server(uint32_t now)
+{
+  if (config_stale && !fetch_config()) return false;
+  if ((!clock_synced || now - last_sync_ms >= CLOCK_SYNC_PERIOD_MS) && !sync_clock()) return false;
 
-  while (multi.run() != WL_CONNECTED)
+  //send rate cap, queued events just pile up and go out in a bigger batch
+  if (now - last_send_ms < setting(codec::ConfigKey::ClientSendIntervalMs)) return true;
+
+  count_event oldest;
+  uint32_t first;
+  if (event_queue_peek(&events, &oldest, 1, &first) > 0)
   {
-    #ifdef ENABLE_SERIAL_DEBUG_OUTPUTS
-      Serial.println("Connecting");
-    #endif
-    rest(500);
+    //hold new events for the batch window so events right after them go out in the same write,
+    //unless a full batch is already waiting
+    if (now - oldest.time_ms < setting(codec::ConfigKey::ClientBatchWindowMs) &&
+        event_queue_size(&events) < codec::MAX_BATCH_EVENTS)
+      return true;
+    return flush_events(codec::MAX_BATCH_EVENTS);
   }
+  //an empty batch, so the server can reply with reboot requests and settings
+  return flush_events(0);
+}
+
+static bool open_connection(WiFiClient &client)
+{
+  if (!client.connect(host, port, CONNECT_TIMEOUT_MS))
+    return false;
+  last_send_ms = millis();
+  return true;
+}
+
+static void write_to_server(WiFiClient &client, codec::Message const &msg)
+{
+  char buf[codec::MAX_ENCODED_LEN];
+  size_t len = codec::encode(msg, buf, sizeof(buf));
+  client.write(reinterpret_cast<const uint8_t*>(buf), len);
   #ifdef ENABLE_SERIAL_DEBUG_OUTPUTS
-    Serial.print("WiFi connection successful with IP ");
-    Serial.println(WiFi.localIP());
+    Serial.print("Sending: ");
+    Serial.write(reinterpret_cast<const uint8_t*>(buf), len);
   #endif
+}
 
+static bool send_simple(codec::Message const &msg)
+{
   WiFiClient client;
-  connect_to_server(client);    
-  write_to_server(client, "client started\n");
-  client.stop();  
+  if (!open_connection(client)) return false;
+  write_to_server(client, msg);
+  bool ok = handle_server_reply(client, NULL);
+  client.stop();
+  return ok;
 }
 
-static void connect_to_server(WiFiClient &client)
+static codec::Message count_message(count_event const &e)
 {
-  while (!client.connect(host, 80)) 
-  {
-    #ifdef ENABLE_SERIAL_DEBUG_OUTPUTS
-      Serial.println("Connection to server failed");
-    #endif
-
-    if (WiFi.status() != WL_CONNECTED)
-    {
-      #ifdef ENABLE_SERIAL_DEBUG_OUTPUTS
-        Serial.print("WiFi disconnected");
-      #endif
-      while (multi.run() != WL_CONNECTED)
-      {
-        #ifdef ENABLE_SERIAL_DEBUG_OUTPUTS
-          Serial.println("Reconnecting");
-        #endif
-        rest(500);
-      }
-      write_to_server(client, "client started\n");
-      #ifdef ENABLE_SERIAL_DEBUG_OUTPUTS
-        Serial.print("WiFi reconnection successful with IP ");
-        Serial.println(WiFi.localIP());
-      #endif
-    }
-    rest(10);
-  }
+  //without a synced clock the server stamps the count with its receive time instead
+  if (clock_synced)
+    return codec::make_message(codec::MsgType::SetCount, e.count, e.time_ms + clock_offset);
+  return codec::make_message(codec::MsgType::SetCount, e.count);
 }
 
-static void write_to_server(WiFiClient &client, String value)
+static bool flush_events(uint32_t max)
 {
-  client.print(value);
+  static count_event batch[codec::MAX_BATCH_EVENTS];
+  static char buf[codec::MAX_ENCODED_LEN * (codec::MAX_BATCH_EVENTS + 1)];
+  uint32_t first;
+  uint32_t n = event_queue_peek(&events, batch, max, &first);
+
+  //one header and all queued events in a single write, acknowledged once
+  size_t len = codec::encode(codec::make_message(codec::MsgType::EventBatch, n, boot_id, first), buf, sizeof(buf));
+  for (uint32_t i = 0; i < n; ++i)
+    len += codec::encode(count_message(batch[i]), buf + len, sizeof(buf) - len);
+
+  WiFiClient client;
+  if (!open_connection(client)) return false;
+  client.write(reinterpret_cast<const uint8_t*>(buf), len);
   #ifdef ENABLE_SERIAL_DEBUG_OUTPUTS
-    Serial.print("Sending: ");
-    if(value.endsWith("\n")) Serial.print(value);
-    else Serial.println(value);
+    if (n > 0) Serial.printf("Sending batch of %u events (%u queued, %u dropped)\n", n, event_queue_size(&events), events.dropped);
   #endif
+  uint32_t acked = first - 1;
+  bool ok = handle_server_reply(client, &acked);
+  client.stop();
+  if (!ok) return false;
+
+  //the server may have recorded only part of the batch, or all of it on an earlier attempt whose
+  //ack was lost; it skips events it already has, so whatever is not acknowledged is simply resent
+  int32_t delivered = (int32_t) (acked - first + 1);
+  if (delivered > 0) event_queue_commit(&events, first, (uint32_t) delivered < n ? (uint32_t) delivered : n);
+  return true;
+}
+
+static bool fetch_config()
+{
+  return send_simple(codec::make_message(codec::MsgType::GetConfig));
 }
 
-static void update_count(uint32_t count)
+static bool sync_clock()
 {
   WiFiClient client;
-  String transmitString = "#" + String(count) + "\n";
-  connect_to_server(client);    
-  write_to_server(client, transmitString);;    
-  handle_reboot_request(client);
-  client.stop();  
+  codec::Message reply;
+  if (!open_connection(client)) return false;
+  uint32_t t0 = millis();
+  write_to_server(client, codec::make_message(codec::MsgType::TimeRequest, t0));
+  read_from_server(client, reply);
+  uint32_t t3 = millis();
+  bool ok = handle_server_reply(client, NULL);
+  client.stop();
+  if (!ok) return false;
+
+  last_sync_ms = t3;
+  if (reply.type != codec::MsgType::TimeReply || reply.args[0] != t0)
+    return true;
+
+  //standard NTP offset/delay, differences are taken in uint32_t so millis() wrap-around is harmless
+  uint32_t t1 = reply.args[1];
+  uint32_t t2 = reply.args[2];
+  clock_sample sample;
+  sample.offset = ((int32_t) (t1 - t0) + (int32_t) (t2 - t3)) / 2;
+  sample.rtt = (t3 - t0) - (t2 - t1);
+  sample.valid = true;
+  clock_samples[clock_sample_idx] = sample;
+  clock_sample_idx = (clock_sample_idx + 1) % CLOCK_SYNC_SAMPLES;
+
+  //the exchange with the lowest round trip time has the least queueing in it and
+  //therefore the tightest error bound (rtt / 2)
+  const clock_sample *best = NULL;
+  for (uint32_t i = 0; i < CLOCK_SYNC_SAMPLES; ++i)
+  {
+    if (clock_samples[i].valid && (best == NULL || clock_samples[i].rtt < best->rtt))
+      best = &clock_samples[i];
+  }
+  clock_offset = best->offset;
+  clock_synced = true;
+  #ifdef ENABLE_SERIAL_DEBUG_OUTPUTS
+    Serial.printf("Clock offset %d ms (+/- %u ms)\n", clock_offset, best->rtt / 2);
+  #endif
+  return true;
 }
 
-static String read_from_server(WiFiClient &client)
+static void reset_clock()
 {
-  client.setTimeout(2);
+  for (uint32_t i = 0; i < CLOCK_SYNC_SAMPLES; ++i) clock_samples[i].valid = false;
+  clock_sample_idx = 0;
+  clock_offset = 0;
+  clock_synced = false;
+}
+
+static bool read_from_server(WiFiClient &client, codec::Message &msg)
+{
+  char buf[codec::MAX_LINE_LEN];
+  client.setTimeout(setting(codec::ConfigKey::ClientReadTimeoutS));
   //wait and see if we get a line from the server
-  return client.readStringUntil('\n');
+  size_t len = client.readBytesUntil('\n', buf, sizeof(buf));
+  return codec::decode(buf, len, msg);
 }
 
-static void handle_reboot_request(WiFiClient &client)
+static bool handle_server_reply(WiFiClient &client, uint32_t *acked_seq)
 {
-  if(read_from_server(client)[0] == 'r')
+  codec::Message msg;
+  bool got_config = false;
+  //settings come first, the reply always ends with an ack or a reboot request
+  while (read_from_server(client, msg) && msg.type == codec::MsgType::Config)
+  {
+    const codec::ConfigSpec *spec = codec::find_config(msg.args[0]);
+    if (spec != NULL && spec->isClient)
+      config[msg.args[0]] = codec::clamp_config(*spec, msg.args[1]);
+    got_config = true;
+  }
+
+  if (msg.type == codec::MsgType::Ack)
+  {
+    //a restarted server's millis() started over, so its clock has to be synced again
+    if (!server_boot_known || msg.args[1] != server_boot)
+    {
+      reset_clock();
+      server_boot = msg.args[1];
+      server_boot_known = true;
+    }
+    if (got_config)
+    {
+      config_version = msg.args[0];
+      config_stale = false;
+      #ifdef ENABLE_SERIAL_DEBUG_OUTPUTS
+        Serial.printf("Applied settings version %u\n", config_version);
+      #endif
+    }
+    else if (msg.args[0] != config_version) config_stale = true;
+    if (acked_seq != NULL && msg.argc > 2) *acked_seq = msg.args[2];
+    return true;
+  }
+  else if(msg.type == codec::MsgType::Reboot)
   {
     client.stop();
     #ifdef ENABLE_SERIAL_DEBUG_OUTPUTS
       Serial.println("Rebooting");
     #endif
-      
+
   ESP.restart();
   }
+  return false;
 }
 
 static void esploop1(void* pvParameters)
@@ -159,7 +368,7 @@ void init_wifi_task()
     NULL,                   /* parameter of the task */
     0,                      /* priority of the task */
     &task_loop1,            /* Task handle to keep track of created task */
-    !ARDUINO_RUNNING_CORE); /* pin task to core */  
+    !ARDUINO_RUNNING_CORE); /* pin task to core */
 }
 
 void rest(uint16_t delay_ms)
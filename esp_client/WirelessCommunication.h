@@ -2,67 +2,180 @@
 #define WIRELESS_COMMUNICATION_H_
 
 #include <WiFi.h>
-#include <WiFiMulti.h>
 #include <stdint.h>
-#include "sharedVariable.h"
+#include "EventQueue.h"
+#include "MessageCodec.h"
+
+//how long a single attempt to connect to the server may take
+#define CONNECT_TIMEOUT_MS 1000
+
+//state of the link to the server, see loop1()
+typedef enum link_state
+{
+  LINK_WIFI_DOWN,    //waiting for WiFi auto reconnect, restarting the join if it takes too long
+  LINK_SERVER_DOWN,  //on WiFi but the server has not answered yet, retrying with backoff
+  LINK_ONLINE        //delivering events
+} link_state;
 
 /*
  * Function:  wireless_init
  * --------------------
- * initializes and connects to WiFi
+ * initializes WiFi and starts connecting, loop1() picks up from there
  */
 static void wireless_init();
 
 /*
- * Function:  connect_to_server
+ * Function:  enter_state
  * --------------------
- * connects to server, this is blocking; code execution will stay 
- * in this function until a connection to server is made
+ * switches the link state machine to the given state, the first attempt in
+ * the new state is made right away
+ */
+static void enter_state(link_state next);
+
+/*
+ * Function:  back_off
+ * --------------------
+ * schedules the next attempt after a failed one: starts at the given setting
+ * and doubles up to ClientBackoffMaxMs (or the initial delay, if that is longer)
  * 
- * also handles dropped WiFi events
+ * initial:  setting holding the first retry delay
+ */
+static void back_off(codec::ConfigKey initial);
+
+/*
+ * Function:  service_server
+ * --------------------
+ * does one round of work while online: refreshes settings and the clock
+ * when needed, then flushes queued events or sends a keepalive
+ * 
+ * now:  current millis()
+ * 
+ * returns false if the server could not be reached
+ */
+static bool service_server(uint32_t now);
+
+/*
+ * Function:  open_connection
+ * --------------------
+ * makes one attempt to connect to the server, waiting at most CONNECT_TIMEOUT_MS
  * 
  * client:  instance of WiFIClient that we want to connect
+ * 
+ * returns true if connected
+ */
+static bool open_connection(WiFiClient &client);
+
+/*
+ * Function:  setting
+ * --------------------
+ * returns the current value of a runtime setting, as last relayed by the server
  */
-static void connect_to_server(WiFiClient &client);
+static uint32_t setting(codec::ConfigKey key);
 
 /*
  * Function:  read_from_server
  * --------------------
- * reads data, if availble, from server. Will wait for 2 seconds before giving up
+ * reads a message, if availble, from server. Will wait for the read timeout setting (2 seconds by default) before giving up
  * 
  * client:  instance of WiFIClient (expected to be already be connected to server)
+ * msg:     decoded message, MsgType::None if there is no data available
  * 
- * returns the read data (not including the '\n') returns empty string if there is no data available
+ * returns true if a known message (or nothing) was received
  */
-static String read_from_server(WiFiClient &client);
+static bool read_from_server(WiFiClient &client, codec::Message &msg);
 
 /*
  * Function:  write_to_server
  * --------------------
- * writes the provided String to the server
+ * encodes the provided message and writes it to the server
  * 
  * client:  instance of WiFIClient (expected to be already be connected to server)
- * value:   String to be written to server
+ * msg:     message to be written to server
  */
-static void write_to_server(WiFiClient &client, String value);
+static void write_to_server(WiFiClient &client, codec::Message const &msg);
+
+//how often the clock is re-synced with the server and how many of the most recent
+//exchanges are kept to pick the best offset from
+#define CLOCK_SYNC_PERIOD_MS 10000
+#define CLOCK_SYNC_SAMPLES 8
+
+typedef struct clock_sample
+{
+  int32_t offset;  //server time - local time
+  uint32_t rtt;    //round trip time excluding server processing
+  bool valid;
+} clock_sample;
 
 /*
- * Function:  update_count
+ * Function:  send_simple
  * --------------------
- * updates server with provided count
+ * sends a single message on its own connection and handles the server's reply
  * 
- * count: value to be sent to server
+ * returns false if the server could not be reached or did not reply
  */
-static void update_count(uint32_t count);
+static bool send_simple(codec::Message const &msg);
 
 /*
- * Function:  handle_reboot_request
+ * Function:  count_message
  * --------------------
- * checks if the server sent a reboot request and reboots if requested
+ * builds the message for a count event, with its time in the server's timebase once the clock is synced
+ */
+static codec::Message count_message(count_event const &e);
+
+/*
+ * Function:  flush_events
+ * --------------------
+ * sends up to max queued events in a single write, numbered by their queue
+ * index; they are only removed from the queue once the server has acknowledged
+ * them, and the server skips any it already has, so resending is harmless
  * 
- * client:  instance of WiFIClient (expected to be already be connected to server)
+ * max:  number of events to send at most, 0 sends an empty batch as a keepalive
+ * 
+ * returns false if the server could not be reached
+ */
+static bool flush_events(uint32_t max);
+
+/*
+ * Function:  fetch_config
+ * --------------------
+ * asks the server for the current client settings and applies them
+ * 
+ * returns false if the server could not be reached
+ */
+static bool fetch_config();
+
+/*
+ * Function:  sync_clock
+ * --------------------
+ * runs one NTP style request/reply exchange with the server and updates the
+ * offset between the server's millis() and ours
+ * 
+ * returns false if the server could not be reached
+ */
+static bool sync_clock();
+
+/*
+ * Function:  reset_clock
+ * --------------------
+ * forgets all clock samples; called whenever the server may have restarted,
+ * since its millis() then started over and the old offset no longer applies
+ */
+static void reset_clock();
+
+/*
+ * Function:  handle_server_reply
+ * --------------------
+ * reads the server's reply: applies any settings it contains, notes if the
+ * server's settings have changed since we last fetched them and reboots if
+ * the server requested it
+ * 
+ * client:     instance of WiFIClient (expected to be already be connected to server)
+ * acked_seq:  set to the newest of our events the server has recorded, if the reply says;
+ *             NULL if not needed
+ * 
+ * returns true if the server acknowledged the message
  */
-static void handle_reboot_request(WiFiClient &client);
+static bool handle_server_reply(WiFiClient &client, uint32_t *acked_seq);
 
 //attaches setup1() and loop1() to the WiFi core (core0)
 static void esploop1(void* pvParameters);
@@ -2,37 +2,86 @@
  * Example Program that counts the number of times the 
  * boot button is pressed and prints it to a server
  * 
+ * with USE_ANALOG_SENSOR defined it instead samples an analog break-beam or
+ * distance sensor at SAMPLE_RATE_HZ and counts every time an object passes
  */
 #include "WirelessCommunication.h"
-#include "sharedVariable.h"
+#include "EventQueue.h"
+#include "AdcSampler.h"
+#include "CrossingDetector.h"
 
 #define BUTTON_PIN 0//boot button
 
+//uncomment following line to count objects with an analog sensor instead of the boot button
+//#define USE_ANALOG_SENSOR
+
+#define SENSOR_PIN 34//must be an ADC1 pin
+#define SAMPLE_RATE_HZ 20000
+//raw 12 bit readings at which an object is considered present/gone, tune for your sensor
+#define SENSOR_ON_THRESHOLD 2500
+#define SENSOR_OFF_THRESHOLD 1800
+#define SENSOR_FILTER_SHIFT 3//EMA over ~8 samples
+#define SENSOR_INVERTED 0//set to 1 if the reading drops when an object is present
+
+#if defined(USE_ANALOG_SENSOR) && !ADC_SAMPLER_SUPPORTED
+#error "USE_ANALOG_SENSOR needs the ADC DMA driver of arduino-esp32 2.0.3 (ESP-IDF 4.4) or later"
+#endif
+
 uint32_t is_pressed();
 void update_button_count();
 
 volatile uint32_t count = 0;
-volatile shared_uint32 x;
+event_queue events;//count events handed to the WiFi task, which delivers them whenever the server is reachable
+
+#ifdef USE_ANALOG_SENSOR
+static crossing_detector detector;
+static uint16_t samples[ADC_SAMPLER_FRAME_SAMPLES];
+#endif
 
 void setup()
 {
   pinMode(BUTTON_PIN, INPUT);
   Serial.begin(115200);
+  event_queue_init(&events);//init queue used to tranfer info to WiFi core
   init_wifi_task();
-  INIT_SHARED_VARIABLE(x, count);//init shared variable used to tranfer info to WiFi core
+#ifdef USE_ANALOG_SENSOR
+  crossing_detector_init(&detector, SENSOR_ON_THRESHOLD, SENSOR_OFF_THRESHOLD, SENSOR_FILTER_SHIFT, SENSOR_INVERTED);
+  if (!adc_sampler_init(SENSOR_PIN, SAMPLE_RATE_HZ))
+    Serial.println("ADC sampler init failed");
+#endif
 }
 
+#ifdef USE_ANALOG_SENSOR
+void loop()
+{
+  //blocks until the DMA has filled the next frame, so this loop runs at SAMPLE_RATE_HZ / ADC_SAMPLER_FRAME_SAMPLES
+  size_t n = adc_sampler_read(samples, ADC_SAMPLER_FRAME_SAMPLES, 100);
+  if (n == 0)
+  {
+    delay(10);//sampler failed to start or stalled, do not spin on this core
+    return;
+  }
+  uint32_t crossings = crossing_detector_process(&detector, samples, n);
+  if (crossings)
+  {
+    count += crossings;
+    update_button_count();//queue the event for the WiFi task
+    Serial.println(count);
+  }
+}
+#else
 void loop()
 {           
   //check if Boot button has been pressed and update values if needed
   if(is_pressed())
   {
     ++count;
-    update_button_count();//update shared variable x (shared with WiFi task)
+    update_button_count();//queue the event for the WiFi task
   }
   Serial.println(count);
   delay(10);
 }
+#endif
 
 uint32_t is_pressed()
 {
@@ -49,12 +98,10 @@ uint32_t is_pressed()
 }
 
 
-//example code that updates a shared variable (which is printed to server)
-//under the hood, this implementation uses a semaphore to arbitrate access to x.value
+//example code that queues the new count (which is printed to server) with the time it changed
+//under the hood, the queue uses a semaphore to arbitrate access; the WiFi task keeps queued events
+//while the server is unreachable and delivers them in batches
 void update_button_count()
 {
-  //minimized time spend holding semaphore
-  LOCK_SHARED_VARIABLE(x);
-  x.value = count;
-  UNLOCK_SHARED_VARIABLE(x);   
+  event_queue_push(&events, count, millis());
 }
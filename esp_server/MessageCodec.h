@@ -0,0 +1 @@
+../common/MessageCodec.h
\ No newline at end of file
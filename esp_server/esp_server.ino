@@ -1,8 +1,28 @@
 #include <WiFi.h>
 #include <esp_task_wdt.h>
+#include "MessageCodec.h"
 #define BUTTON_PIN 0//boot button
+#define EVENT_RING_SIZE 256//number of recent count events kept for GUI backfill
+#define BACKFILL_BATCH_BYTES 512//largest slice of backfill written to serial per loop() pass
+#define SERIAL_BAUD 921600//GUI link, must match the GUI's baud rate setting
+#define WDT_TIMEOUT_S 5//loop() must feed the watchdog within this, each client read can block for ServerReadTimeoutS
+#define MAX_CLIENTS 16//stations whose delivered events are tracked, the one not heard from the longest is forgotten first
 
 void IRAM_ATTR reset_req_TSR();
+void send_message(Print &out, codec::Message const &msg);
+void print_count(uint32_t value, uint32_t time_ms);
+bool is_repeat(uint32_t value);
+uint32_t event_time(codec::Message const &msg, uint32_t receivedAt);
+void send_time_reply(Print &out, uint32_t t0, uint32_t t1);
+void handle_serial();
+void send_backfill(uint32_t boot, uint32_t after_seq);
+void stream_backfill();
+uint32_t oldest_seq();
+void apply_config(uint32_t key, uint32_t value);
+struct client_state;
+client_state *find_client(uint32_t boot, uint32_t first);
+client_state *receive_batch(WiFiClient &client, codec::Message const &header, uint32_t receivedAt);
+void send_config(Print &out, bool clientOnly);
 void measure_delta_time(uint32_t len);//TODO: modify this function (found below) to print
                                      //max, and min delta times in addition to the current one
 
@@ -14,10 +34,44 @@ volatile uint32_t count = 0;
 volatile uint32_t resetRequestFlag = 0;
 volatile uint32_t lastResetTime = 0;
 volatile uint32_t isFirstMeasurement = 1;
+codec::LineReader<> serialLine;//partial line received from the GUI
+
+//recent count events, so the GUI can catch up on what it missed while its port was closed
+struct count_event
+{
+  uint32_t seq;
+  uint32_t count;
+  uint32_t time_ms;
+};
+count_event eventRing[EVENT_RING_SIZE];
+uint32_t lastSeq = 0;//seq of the newest event, event seq is stored at eventRing[seq % EVENT_RING_SIZE]
+uint32_t bootId = 0;//identifies this run so the GUI and the clients can tell when seq and millis() have started over
+uint32_t backfillNext = 0;//next seq streamed to the GUI, 0 while no backfill is in progress
+
+//newest event recorded from each station, so a batch that is resent because its ack was lost
+//(or that was cut short) does not record its events twice
+struct client_state
+{
+  bool known;        //slot is in use
+  uint32_t boot;     //random id the station picked at boot
+  uint32_t lastSeq;  //seq of its newest event recorded
+  uint32_t lastSeen; //millis() of its last batch
+};
+client_state clients[MAX_CLIENTS];
+
+//runtime settings (see codec::CONFIG_TABLE), changed from the GUI
+static_assert(codec::CONFIG_TABLE[(size_t) codec::ConfigKey::ServerReadTimeoutS].maxValue * 2 < WDT_TIMEOUT_S,
+              "a client that stops sending must not block loop() long enough to trip the watchdog");
+uint32_t config[codec::CONFIG_KEY_COUNT];
+uint32_t configVersion = 0;//sent to clients with every reply, changes whenever a client setting changes
 
 void setup()
 {
-  Serial.begin(115200);
+  Serial.setTxBufferSize(1024);//room for a backfill slice without blocking
+  Serial.begin(SERIAL_BAUD);
+  bootId = esp_random();
+  for (size_t i = 0; i < codec::CONFIG_KEY_COUNT; ++i) config[i] = codec::CONFIG_TABLE[i].defaultValue;
+  configVersion = esp_random();//random so clients notice a restarted server's (default) settings
   
   // WiFi connection procedure
   WiFi.mode(WIFI_AP);
@@ -28,7 +82,7 @@ void setup()
   server.begin();
 
   //watchdog timer with 5s period
-  esp_task_wdt_init(5, true); //enable watchdog (which will restart ESP32 if it hangs)
+  esp_task_wdt_init(WDT_TIMEOUT_S, true); //enable watchdog (which will restart ESP32 if it hangs)
   esp_task_wdt_add(NULL); //add current thread to WDT watch
   
   Serial.println("server started");
@@ -42,43 +96,234 @@ void setup()
 void loop()
 {
   WiFiClient client = server.available();
-  client.setTimeout(2);//will wait for maximum of 2 seconds for data
+  client.setTimeout(config[(size_t) codec::ConfigKey::ServerReadTimeoutS]);//will wait for maximum of this many seconds for data
   if (client)
   {
     if (client.connected())
     {
-      String line = client.readStringUntil('\n');
+      char line[codec::MAX_LINE_LEN];
+      size_t len = client.readBytesUntil('\n', line, sizeof(line));
+      uint32_t receivedAt = millis();
+      codec::Message msg;
+      codec::decode(line, len, msg);
+      client_state *sender = NULL;//set for event batches, their ack reports what was recorded
       //print updated count or the received line
-      //note that if the received line starts with '-', '+', or '#', the code will assume we are decrementing, incrementing, or setting the count, respectively
-      //recieved lines starting with any other character will be printed to the serial monitor
-      //more cases can be added
-      switch(line[0])
+      //note that if the received message is '-', '+', or '#<n>', the code will assume we are decrementing, incrementing, or setting the count, respectively
+      //recieved lines that are not a known message will be printed to the serial monitor
+      //more cases can be added to codec::MESSAGE_TABLE
+      switch(msg.type)
       {
-        case '-'  : Serial.printf("%u\n", --count);
+        case codec::MsgType::Decrement : print_count(--count, receivedAt);
+          break;
+        case codec::MsgType::Increment : print_count(++count, receivedAt);
+          break;
+        case codec::MsgType::SetCount  : if (!is_repeat(msg.args[0])) print_count(count = msg.args[0], event_time(msg, receivedAt));
+          break;
+        case codec::MsgType::TimeRequest : send_time_reply(client, msg.args[0], receivedAt);
           break;
-        case '+'  : Serial.printf("%u\n", ++count);
+        case codec::MsgType::GetConfig : send_config(client, true);
           break;
-        case '#'  : Serial.printf("%u\n", count = line.substring(1).toInt());
+        case codec::MsgType::EventBatch : sender = receive_batch(client, msg, receivedAt);
           break;
-        case '\0' : //nothing to do if empty String
+        case codec::MsgType::None      : //nothing to do if empty line
           break;
-        default   : Serial.println(line);
-          if(line.indexOf("client started") >= 0) resetRequestFlag = 0;//indicates reset was sucessful
+        case codec::MsgType::ClientStarted : Serial.println("client started");
+          resetRequestFlag = 0;//indicates reset was sucessful
+          break;
+        default   : Serial.write(reinterpret_cast<const uint8_t*>(line), len);
+          Serial.println();
       }
       //if flag is set, we send a reset request
       if (resetRequestFlag)
       {
-        client.print("r\n");
+        send_message(client, codec::make_message(codec::MsgType::Reboot));
         Serial.println("client reset!");
         lastResetTime = millis(); 
       }
-      else client.print("\n");//print something to client so it doesn't have to wait for entirety of timeout when checking for reset
+      else if (sender != NULL) send_message(client, codec::make_message(codec::MsgType::Ack, configVersion, bootId, sender->lastSeq));
+      else send_message(client, codec::make_message(codec::MsgType::Ack, configVersion, bootId));//print something to client so it doesn't have to wait for entirety of timeout when checking for reset, the version tells it whether its settings are current
       client.stop();
     }
   }
+  handle_serial();
+  stream_backfill();
   esp_task_wdt_reset();
 }
 
+//handles requests from the GUI, which are read without blocking
+void handle_serial()
+{
+  while (Serial.available() > 0)
+  {
+    char c = (char) Serial.read();
+    uint32_t receivedAt = millis();
+    if (!serialLine.push(c)) continue;
+
+    codec::Message msg;
+    codec::decode(serialLine.data(), serialLine.size(), msg);
+    switch(msg.type)
+    {
+      case codec::MsgType::TimeRequest : send_time_reply(Serial, msg.args[0], receivedAt);
+        break;
+      case codec::MsgType::Backfill : send_backfill(msg.args[0], msg.args[1]);
+        break;
+      case codec::MsgType::Config : apply_config(msg.args[0], msg.args[1]);
+        break;
+      case codec::MsgType::GetConfig : send_config(Serial, false);
+        break;
+      default : //ignore anything else
+        break;
+    }
+  }
+}
+
+//encodes msg into a stack buffer and writes it to out (a WiFiClient or Serial)
+void send_message(Print &out, codec::Message const &msg)
+{
+  char buf[codec::MAX_ENCODED_LEN];
+  size_t len = codec::encode(msg, buf, sizeof(buf));
+  out.write(reinterpret_cast<const uint8_t*>(buf), len);
+}
+
+//a plain SetCount only says where counting stands, so a repeat of the last count is not a new event
+//events in a batch are real changes (deduplicated by their seq) and are always recorded
+bool is_repeat(uint32_t value)
+{
+  return lastSeq != 0 && eventRing[lastSeq % EVENT_RING_SIZE].count == value;
+}
+
+//records a count event and reports it, with the time (server millis()) it happened, to the GUI over serial
+void print_count(uint32_t value, uint32_t time_ms)
+{
+  count_event &e = eventRing[++lastSeq % EVENT_RING_SIZE];
+  e.seq = lastSeq;
+  e.count = value;
+  e.time_ms = time_ms;
+  //while a backfill is streaming, new events go out with it so the GUI gets them in order
+  if (backfillNext == 0)
+    send_message(Serial, codec::make_message(codec::MsgType::SetCount, e.count, e.time_ms, e.seq));
+}
+
+//clients with a synced clock send the event time, otherwise the receive time is used
+//an event cannot have happened after it was received, so later times (e.g. stamped with the offset of
+//a previous run of this server) are clamped to the receive time
+uint32_t event_time(codec::Message const &msg, uint32_t receivedAt)
+{
+  if (msg.argc < 2 || (int32_t) (msg.args[1] - receivedAt) > 0) return receivedAt;
+  return msg.args[1];
+}
+
+//seq of the oldest event still in the ring
+uint32_t oldest_seq()
+{
+  return lastSeq >= EVENT_RING_SIZE ? lastSeq - EVENT_RING_SIZE + 1 : 1;
+}
+
+//starts sending the events after after_seq that are still in the ring, stream_backfill() writes them
+//if boot does not match this run, the GUI's seq belongs to a previous run and everything is sent
+void send_backfill(uint32_t boot, uint32_t after_seq)
+{
+  uint32_t oldest = oldest_seq();
+  uint32_t first = (boot == bootId && after_seq >= oldest) ? after_seq + 1 : oldest;
+  send_message(Serial, codec::make_message(codec::MsgType::BackfillStart, bootId, first, lastSeq));
+  backfillNext = first <= lastSeq ? first : 0;
+}
+
+//writes the next slice of a backfill in progress, only as much as fits in the serial TX buffer,
+//so loop() never waits on the GUI link and keeps serving clients while the ring is sent
+void stream_backfill()
+{
+  if (backfillNext == 0) return;
+  //events overwritten while streaming are lost, the GUI sees the gap and asks again
+  if (backfillNext < oldest_seq()) backfillNext = oldest_seq();
+
+  char batch[BACKFILL_BATCH_BYTES];
+  size_t room = Serial.availableForWrite();
+  if (room > sizeof(batch)) room = sizeof(batch);
+  size_t len = 0;
+  for (; backfillNext <= lastSeq && room - len >= codec::MAX_ENCODED_LEN; ++backfillNext)
+  {
+    count_event const &e = eventRing[backfillNext % EVENT_RING_SIZE];
+    len += codec::encode(codec::make_message(codec::MsgType::SetCount, e.count, e.time_ms, e.seq), batch + len, room - len);
+  }
+  if (len > 0) Serial.write(reinterpret_cast<const uint8_t*>(batch), len);
+  if (backfillNext > lastSeq) backfillNext = 0;
+}
+
+//answers a clock sync request; t0 is echoed back, t1 is when the request was received
+//and the send time is taken as late as possible
+void send_time_reply(Print &out, uint32_t t0, uint32_t t1)
+{
+  send_message(out, codec::make_message(codec::MsgType::TimeReply, t0, t1, millis()));
+}
+
+//returns the state of the station run boot, starting to track it (from event first on) if it is new
+client_state *find_client(uint32_t boot, uint32_t first)
+{
+  client_state *slot = &clients[0];
+  for (size_t i = 0; i < MAX_CLIENTS; ++i)
+  {
+    client_state &c = clients[i];
+    if (c.known && c.boot == boot) return &c;
+    if (slot->known && (!c.known || (int32_t) (c.lastSeen - slot->lastSeen) < 0)) slot = &c;
+  }
+  slot->known = true;
+  slot->boot = boot;
+  slot->lastSeq = first - 1;
+  return slot;
+}
+
+//reads the count events a client queued while it was offline, each one keeps its own event time
+//events the station already delivered are skipped; if the batch is cut short the events read so far
+//stay recorded and the ack tells the client where to continue
+//returns the sender's state, NULL if the batch is invalid
+client_state *receive_batch(WiFiClient &client, codec::Message const &header, uint32_t receivedAt)
+{
+  uint32_t n = header.args[0];
+  uint32_t first = header.args[2];
+  if (n > codec::MAX_BATCH_EVENTS) return NULL;
+  client_state *sender = find_client(header.args[1], first);
+  sender->lastSeen = receivedAt;
+  for (uint32_t i = 0; i < n; ++i)
+  {
+    esp_task_wdt_reset();//every line may take up to the read timeout
+    char line[codec::MAX_LINE_LEN];
+    size_t len = client.readBytesUntil('\n', line, sizeof(line));
+    codec::Message msg;
+    if (len == 0 || !codec::decode(line, len, msg) || msg.type != codec::MsgType::SetCount) break;
+    uint32_t seq = first + i;
+    if ((int32_t) (seq - sender->lastSeq) <= 0) continue;
+    print_count(count = msg.args[0], event_time(msg, receivedAt));
+    sender->lastSeq = seq;
+  }
+  return sender;
+}
+
+//stores a setting from the GUI and reports the value actually applied back to it
+//client settings are picked up by the clients on their next message through the new configVersion
+void apply_config(uint32_t key, uint32_t value)
+{
+  const codec::ConfigSpec *spec = codec::find_config(key);
+  if (spec == NULL) return;
+  value = codec::clamp_config(*spec, value);
+  if (config[key] != value)
+  {
+    config[key] = value;
+    if (spec->isClient) ++configVersion;
+  }
+  send_message(Serial, codec::make_message(codec::MsgType::Config, key, value));
+}
+
+//sends the current settings, clients only get the ones that apply to them
+void send_config(Print &out, bool clientOnly)
+{
+  for (uint32_t key = 0; key < codec::CONFIG_KEY_COUNT; ++key)
+  {
+    if (clientOnly && !codec::CONFIG_TABLE[key].isClient) continue;
+    send_message(out, codec::make_message(codec::MsgType::Config, key, config[key]));
+  }
+}
+
 //set reset flag if boot button is pressed
 void IRAM_ATTR reset_req_TSR()
 {
@@ -1,13 +1,12 @@
 #include "console.h"
 
-#include "QDateTime"
 #include "QScrollBar"
 
 Console::Console(QWidget* parent) : QPlainTextEdit(parent) {
     setReadOnly(true);
 }
 
-void Console::printData(QByteArray const& data) {
+void Console::printData(QByteArray const& data, QDateTime const& timestamp) {
     QScrollBar* bar = verticalScrollBar();
     int previousScrollValue = bar->value();
     bool isAtMaxScroll = (bar->value() == bar->maximum());
@@ -23,7 +22,8 @@ void Console::printData(QByteArray const& data) {
     }
 
     if (mIsTimestampEnabled) {
-        insertPlainText(QDateTime::currentDateTime().toString("[yyyy-MM-dd HH:mm:ss.zzz] "));
+        QDateTime const time = timestamp.isValid() ? timestamp : QDateTime::currentDateTime();
+        insertPlainText(time.toString("[yyyy-MM-dd HH:mm:ss.zzz] "));
     }
 
     insertPlainText(data.trimmed());
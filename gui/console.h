@@ -1,5 +1,6 @@
 #pragma once
 
+#include "QDateTime"
 #include "QPlainTextEdit"
 
 class Console : public QPlainTextEdit {
@@ -13,7 +14,8 @@ public:
     [[nodiscard]] auto isTimestampEnabled() const -> bool { return mIsTimestampEnabled; }
 
 public slots:
-    void printData(QByteArray const& data);
+    // timestamp is shown when timestamps are enabled; defaults to the current time
+    void printData(QByteArray const& data, QDateTime const& timestamp = {});
     void printLine(QString const& line);
 
 private:
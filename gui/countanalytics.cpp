@@ -0,0 +1,91 @@
+#include "countanalytics.h"
+
+#include <algorithm>
+
+namespace {
+    auto floorDiv(std::int64_t a, std::int64_t b) -> std::int64_t {
+        std::int64_t q = a / b;
+        if ((a % b != 0) && ((a < 0) != (b < 0))) --q;
+        return q;
+    }
+} // namespace
+
+void CountAnalytics::addEvent(std::int64_t timeMs, std::uint32_t amount) {
+    std::int64_t const second = floorDiv(timeMs, BUCKET_MS);
+    if (mHeadSecond < 0 || second > mHeadSecond) {
+        stepTo(second);
+    }
+    if (second <= mHeadSecond - static_cast<std::int64_t>(BUCKET_COUNT)) {
+        return;
+    }
+
+    Bucket& bucket = mBuckets[static_cast<std::size_t>(second) % BUCKET_COUNT];
+    if (bucket.second != second) {
+        bucket.second = second;
+        bucket.count = 0;
+    }
+    bucket.count += amount;
+
+    for (std::size_t w = 0; w < WINDOW_COUNT; ++w) {
+        if (second > mHeadSecond - WINDOW_SECONDS[w]) {
+            mSums[w] += amount;
+        }
+    }
+    mPeakPerMinute = std::max(mPeakPerMinute, mSums[0]);
+
+    if (mFirstSecond < 0 || second < mFirstSecond) {
+        mFirstSecond = second;
+    }
+    if (timeMs >= mLastEventMs) {
+        if (mLastEventMs >= 0) {
+            mLongestIdleMs = std::max(mLongestIdleMs, timeMs - mLastEventMs);
+        }
+        mLastEventMs = timeMs;
+    }
+}
+
+void CountAnalytics::advanceTo(std::int64_t timeMs) {
+    std::int64_t const second = floorDiv(timeMs, BUCKET_MS);
+    if (mHeadSecond >= 0 && second > mHeadSecond) {
+        stepTo(second);
+    }
+}
+
+void CountAnalytics::reset() {
+    *this = CountAnalytics{};
+}
+
+void CountAnalytics::stepTo(std::int64_t second) {
+    if (mHeadSecond < 0 || second - mHeadSecond >= static_cast<std::int64_t>(BUCKET_COUNT)) {
+        // everything falls out of every window, stale buckets are recognised by their tag
+        mSums.fill(0);
+        mHeadSecond = second;
+        return;
+    }
+
+    while (mHeadSecond < second) {
+        ++mHeadSecond;
+        for (std::size_t w = 0; w < WINDOW_COUNT; ++w) {
+            std::int64_t const leaving = mHeadSecond - WINDOW_SECONDS[w];
+            Bucket const& bucket = mBuckets[static_cast<std::size_t>(leaving) % BUCKET_COUNT];
+            if (bucket.second == leaving) {
+                mSums[w] -= bucket.count;
+            }
+        }
+    }
+}
+
+auto CountAnalytics::snapshot(std::int64_t nowMs) const -> Snapshot {
+    Snapshot s;
+    std::int64_t const nowSecond = floorDiv(nowMs, BUCKET_MS);
+    for (std::size_t w = 0; w < WINDOW_COUNT; ++w) {
+        if (mFirstSecond < 0) break;
+        // average over the part of the window we have been running for
+        std::int64_t const covered = std::clamp<std::int64_t>(nowSecond - mFirstSecond + 1, 1, WINDOW_SECONDS[w]);
+        s.perMinute[w] = static_cast<double>(mSums[w]) * 60.0 / static_cast<double>(covered);
+    }
+    s.peakPerMinute = mPeakPerMinute;
+    s.idleMs = mLastEventMs >= 0 ? std::max<std::int64_t>(0, nowMs - mLastEventMs) : 0;
+    s.longestIdleMs = std::max(mLongestIdleMs, s.idleMs);
+    return s;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Rolling throughput statistics over the count stream.
+//
+// Events are accumulated into one second buckets kept in a fixed ring covering the
+// longest window. Every window keeps a running sum that is adjusted as buckets enter
+// and leave it, so recording an event or advancing time is O(1) (amortized over the
+// elapsed seconds) and memory does not grow with the run length.
+class CountAnalytics {
+public:
+    static constexpr std::size_t WINDOW_COUNT = 3;
+    static constexpr std::array<std::int64_t, WINDOW_COUNT> WINDOW_SECONDS{60, 5 * 60, 15 * 60};
+    static constexpr std::int64_t BUCKET_MS = 1000;
+
+    struct Snapshot {
+        // average counts per minute over the last 1, 5 and 15 minutes
+        std::array<double, WINDOW_COUNT> perMinute{};
+        // highest count over any one minute window seen so far
+        std::uint64_t peakPerMinute = 0;
+        // time since the last event and longest gap between two events (ms)
+        std::int64_t idleMs = 0;
+        std::int64_t longestIdleMs = 0;
+    };
+
+    // Records `amount` counts that happened at `timeMs`. Events older than the longest
+    // window are ignored; events older than the last recorded one (e.g. history
+    // replayed after a reconnect) are merged into their bucket.
+    void addEvent(std::int64_t timeMs, std::uint32_t amount = 1);
+    // Moves the windows forward so counts that are too old drop out.
+    void advanceTo(std::int64_t timeMs);
+    void reset();
+
+    // Call advanceTo(nowMs) first so the windows are up to date.
+    [[nodiscard]] auto snapshot(std::int64_t nowMs) const -> Snapshot;
+
+private:
+    static constexpr std::size_t BUCKET_COUNT = WINDOW_SECONDS.back();
+
+    struct Bucket {
+        std::int64_t second = -1; // second this bucket currently holds, stale if it does not match
+        std::uint64_t count = 0;
+    };
+
+    void stepTo(std::int64_t second);
+
+    std::array<Bucket, BUCKET_COUNT> mBuckets{};
+    std::array<std::uint64_t, WINDOW_COUNT> mSums{};
+    std::int64_t mHeadSecond = -1;
+    std::int64_t mFirstSecond = -1;
+    std::int64_t mLastEventMs = -1;
+    std::int64_t mLongestIdleMs = 0;
+    std::uint64_t mPeakPerMinute = 0;
+};
@@ -1,5 +1,6 @@
 #include "mainwindow.h"
 
+#include <QDateTime>
 #include <QDebug>
 #include <QDesktopWidget>
 #include <QDockWidget>
@@ -10,11 +11,22 @@
 #include <QVBoxLayout>
 #include <QWidget>
 
+#include <algorithm>
+
+namespace {
+    // How often the server clock is sampled while the port is open
+    constexpr int TIME_SYNC_INTERVAL_MS = 2000;
+} // namespace
+
 MainWindow::MainWindow() {
+    mHostClock.start();
+    mHostEpochMs = QDateTime::currentMSecsSinceEpoch();
+
     resize(QDesktopWidget().availableGeometry(this).size() * 0.7);
 
     mSettings = new SettingsDialog(this);
     connect(mSettings, &SettingsDialog::applyClicked, this, &MainWindow::settingsApplied, Qt::QueuedConnection);
+    connect(mSettings, &SettingsDialog::sendTuningClicked, this, &MainWindow::sendTuning);
 
     auto* consoleDock = new QDockWidget(tr("Log"), this);
     consoleDock->setFeatures(QDockWidget::DockWidgetClosable |
@@ -43,10 +55,16 @@ MainWindow::MainWindow() {
     mCounterLabel->setAlignment(Qt::AlignCenter);
 
     mDeltaLabel = new QLabel("+0");
+    mAnalyticsLabel = new QLabel;
+
+    auto* sideLayout = new QVBoxLayout;
+    sideLayout->addWidget(mDeltaLabel, 0, Qt::AlignLeft | Qt::AlignTop);
+    sideLayout->addStretch();
+    sideLayout->addWidget(mAnalyticsLabel, 0, Qt::AlignLeft | Qt::AlignBottom);
 
     auto* subLayout = new QHBoxLayout;
     subLayout->addWidget(mCounterLabel, 0, Qt::AlignRight);
-    subLayout->addWidget(mDeltaLabel, 0, Qt::AlignLeft | Qt::AlignTop);
+    subLayout->addLayout(sideLayout);
 
     auto* layout = new QVBoxLayout;
     layout->addStretch();
@@ -81,6 +99,16 @@ MainWindow::MainWindow() {
     clearAct->setStatusTip(tr("Clear counter"));
     fileToolbar->addAction(clearAct);
     connect(clearAct, &QAction::triggered, this, [this]() { resetCounter(); });
+
+    // The engine is updated on every count; the label is refreshed on a timer so bursts of
+    // counts do not re-render it each time and the rates keep decaying while no counts arrive
+    auto* analyticsTimer = new QTimer(this);
+    connect(analyticsTimer, &QTimer::timeout, this, &MainWindow::updateAnalytics);
+    analyticsTimer->start(250);
+    updateAnalytics();
+
+    mSyncTimer = new QTimer(this);
+    connect(mSyncTimer, &QTimer::timeout, this, &MainWindow::requestTimeSync);
 }
 
 MainWindow::~MainWindow() {
@@ -88,6 +116,18 @@ MainWindow::~MainWindow() {
 }
 
 void MainWindow::setCounter(std::size_t value) {
+    setCounter(value, nowMs());
+}
+
+void MainWindow::setCounter(std::size_t value, qint64 eventTimeMs) {
+    // the server reports absolute counts, so the first one only tells where counting stands and
+    // is not a burst of events
+    if (!mHasBaseline) {
+        mHasBaseline = true;
+        mCounterValue = value;
+        mCounterLabel->setText(QString::number(mCounterValue));
+        return;
+    }
     if (value == mCounterValue) {
         return;
     }
@@ -98,12 +138,38 @@ void MainWindow::setCounter(std::size_t value) {
 
     mCounterValue = value;
     mCounterLabel->setText(QString::number(mCounterValue));
+
+    if (diff > 0) {
+        mAnalytics.addEvent(eventTimeMs, static_cast<std::uint32_t>(diff));
+    }
 }
 
 void MainWindow::resetCounter() {
-    mCounterValue = 0;
+    // only the display and the statistics start over; mCounterValue keeps the server's count so
+    // the next change is still counted as an event
     mCounterLabel->setText("0");
     mDeltaLabel->setText("+0");
+    mAnalytics.reset();
+    updateAnalytics();
+}
+
+void MainWindow::updateAnalytics() {
+    qint64 const now = nowMs();
+    mAnalytics.advanceTo(now);
+    CountAnalytics::Snapshot const s = mAnalytics.snapshot(now);
+
+    mAnalyticsLabel->setText(tr("Rate (per min)\n"
+                                "  1 min: %1\n"
+                                "  5 min: %2\n"
+                                "  15 min: %3\n"
+                                "Peak: %4 / min\n"
+                                "Idle: %5 s (longest %6 s)")
+                                     .arg(s.perMinute[0], 0, 'f', 1)
+                                     .arg(s.perMinute[1], 0, 'f', 1)
+                                     .arg(s.perMinute[2], 0, 'f', 1)
+                                     .arg(s.peakPerMinute)
+                                     .arg(s.idleMs / 1000)
+                                     .arg(s.longestIdleMs / 1000));
 }
 
 void MainWindow::settingsApplied() {
@@ -129,7 +195,7 @@ void MainWindow::openSerialPort() {
     mSerial->setParity(QSerialPort::NoParity);
     mSerial->setStopBits(QSerialPort::OneStop);
     mSerial->setFlowControl(QSerialPort::NoFlowControl);
-    if (!mSerial->open(QIODevice::ReadOnly)) {
+    if (!mSerial->open(QIODevice::ReadWrite)) {
         QMessageBox::critical(this, tr("Error"), mSerial->errorString());
         mConsole->printLine(tr("Open error: %1").arg(mSerial->errorString()));
     }
@@ -142,16 +208,28 @@ void MainWindow::openSerialPort() {
         mSerial->setStopBits(QSerialPort::OneStop);
         mSerial->setFlowControl(QSerialPort::NoFlowControl);
         mSerial->setDataTerminalReady(true);
+        requestTimeSync();
+        // show the settings the server is actually running with
+        sendMessage(codec::make_message(codec::MsgType::GetConfig));
     });
+    // Opening the port resets some boards, so the server's clock may have started over
+    mServerClock.reset();
+    mSyncTimer->start(TIME_SYNC_INTERVAL_MS);
+    // Events are requested once the clock is synced so their timestamps can be mapped
+    mAwaitingBackfill = true;
 }
 
 void MainWindow::closeSerialPort() {
+    mSyncTimer->stop();
     if (mSerial->isOpen()) {
+        // the ESP32 auto-reset circuit pulls EN low while DTR is off and RTS is on, so RTS goes
+        // first; resetting the server would wipe the event history the next open backfills from
+        mSerial->setRequestToSend(false);
         mSerial->setDataTerminalReady(false);
         mSerial->close();
         mConsole->printLine(tr("Disconnected"));
     }
-    mRxBuf.clear();
+    mRxLine.reset();
 }
 
 void MainWindow::readData() {
@@ -160,29 +238,131 @@ void MainWindow::readData() {
         return;
     }
 
-    mRxBuf.append(mSerial->readAll());
+    char chunk[256];
+    for (;;) {
+        qint64 const n = mSerial->read(chunk, sizeof(chunk));
+        if (n <= 0) break;
+        mRxLine.feed(chunk, static_cast<std::size_t>(n), [this](char const* line, std::size_t len) { processLine(line, len); });
+    }
+}
 
-    if (!mRxBuf.isEmpty() && !(mRxBuf[0] == '\n' || mRxBuf[0] == '\r' || (QChar(mRxBuf[0]).isDigit()))) {
-        mConsole->printLine(mRxBuf);
-        mRxBuf.clear();
+void MainWindow::processLine(char const* line, std::size_t len) {
+    codec::Message msg;
+    codec::decode(line, len, msg);
+
+    switch (msg.type) {
+        case codec::MsgType::TimeReply: {
+            qint64 const hostRecv = mHostClock.elapsed();
+            // only the low 32 bits of the send time made the round trip
+            qint64 const hostSend = hostRecv - static_cast<std::uint32_t>(static_cast<std::uint32_t>(hostRecv) - msg.args[0]);
+            mServerClock.addSample(hostSend, msg.args[1], msg.args[2], hostRecv);
+            // also retries a backfill request that got lost
+            if (mAwaitingBackfill) {
+                requestBackfill();
+            }
+            return;
+        }
+        case codec::MsgType::BackfillStart:
+            startBackfill(msg);
+            return;
+        case codec::MsgType::Config:
+            mSettings->setTuningValue(msg.args[0], msg.args[1]);
+            mConsole->printData(QByteArray::fromRawData(line, static_cast<int>(len)));
+            return;
+        case codec::MsgType::SetCount: {
+            if (msg.argc > 2 && !acceptEventSeq(msg.args[2])) {
+                return;
+            }
+            // a bad clock fit must not put events in the future, the analytics would not
+            // count anything until the host clock caught up with them
+            qint64 const eventTime = (msg.argc > 1 && mServerClock.isSynced())
+                                             ? std::min(mHostEpochMs + mServerClock.toHost(msg.args[1]), nowMs())
+                                             : nowMs();
+            mConsole->printData(QByteArray::fromRawData(line, static_cast<int>(len)), QDateTime::fromMSecsSinceEpoch(eventTime));
+            setCounter(msg.args[0], eventTime);
+            return;
+        }
+        default:
+            mConsole->printData(QByteArray::fromRawData(line, static_cast<int>(len)));
+            return;
+    }
+}
+
+void MainWindow::sendMessage(codec::Message const& msg) {
+    if (!mSerial->isOpen()) {
         return;
     }
+    char buf[codec::MAX_ENCODED_LEN];
+    std::size_t const len = codec::encode(msg, buf, sizeof(buf));
+    mSerial->write(buf, static_cast<qint64>(len));
+}
 
-    for (;;) {
-        int nl = mRxBuf.indexOf('\n');
-        if (nl < 0) break;
-        QByteArray line = mRxBuf.left(nl + 1);
-        mRxBuf.remove(0, nl + 1);
-        processLine(line);
+void MainWindow::requestTimeSync() {
+    sendMessage(codec::make_message(codec::MsgType::TimeRequest, static_cast<std::uint32_t>(mHostClock.elapsed())));
+}
+
+void MainWindow::requestBackfill() {
+    mAwaitingBackfill = true;
+    sendMessage(codec::make_message(codec::MsgType::Backfill, mServerBootId.value_or(0), mLastSeq));
+}
+
+void MainWindow::startBackfill(codec::Message const& msg) {
+    std::uint32_t const bootId = msg.args[0];
+    std::uint32_t const first = msg.args[1];
+    std::uint32_t const last = msg.args[2];
+
+    if (mServerBootId != bootId) {
+        if (mServerBootId) {
+            mConsole->printLine(tr("Server restarted"));
+            // the new run's millis() started over, the old samples would skew the fit
+            mServerClock.reset();
+            requestTimeSync();
+        }
+        mServerBootId = bootId;
+        // a new run's counts are unrelated to the ones shown so far
+        mHasBaseline = false;
+        mLastSeq = 0;
     }
+    if (first == 1 && mLastSeq == 0) {
+        // the whole run is backfilled, so its first event counted up from 0
+        mHasBaseline = true;
+        mCounterValue = 0;
+        mCounterLabel->setText("0");
+    }
+    if (first > mLastSeq + 1) {
+        mConsole->printLine(tr("%1 events were lost before they could be backfilled").arg(first - mLastSeq - 1));
+    }
+    if (first <= last && last > mLastSeq) {
+        mConsole->printLine(tr("Backfilling %1 events").arg(last - std::max(first - 1, mLastSeq)));
+    }
+    // a stale reply to a retried request must not move us backwards
+    mLastSeq = std::max(mLastSeq, first - 1);
+    mAwaitingBackfill = false;
 }
 
-void MainWindow::processLine(QByteArray const& line) {
-    mConsole->printData(line);
+auto MainWindow::acceptEventSeq(std::uint32_t seq) -> bool {
+    // anything sent before the backfill reply is also part of the backfill
+    if (mAwaitingBackfill) {
+        return false;
+    }
+    // a gap means lines were lost; an old seq is either a duplicate or the server restarted,
+    // which the boot id in the backfill reply tells apart
+    if (seq != mLastSeq + 1) {
+        requestBackfill();
+        return false;
+    }
+    mLastSeq = seq;
+    return true;
+}
 
-    bool ok = false;
-    std::size_t value = line.trimmed().toUInt(&ok);
-    if (ok) {
-        setCounter(value);
+void MainWindow::sendTuning() {
+    if (!mSerial->isOpen()) {
+        mConsole->printLine(tr("Open a serial port before sending tuning"));
+        return;
+    }
+    auto const values = mSettings->tuning();
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        sendMessage(codec::make_message(codec::MsgType::Config, static_cast<std::uint32_t>(i), values[i]));
     }
+    mConsole->printLine(tr("Sent tuning to server"));
 }
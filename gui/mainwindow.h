@@ -1,12 +1,19 @@
 #pragma once
 
+#include <QElapsedTimer>
 #include <QMainWindow>
 
+#include <optional>
+
+#include "MessageCodec.h"
 #include "console.h"
+#include "countanalytics.h"
+#include "serverclock.h"
 #include "settingsdialog.h"
 
 QT_BEGIN_NAMESPACE
 class QLabel;
+class QTimer;
 QT_END_NAMESPACE
 
 class MainWindow : public QMainWindow {
@@ -18,6 +25,8 @@ public:
 
 public slots:
     void setCounter(std::size_t value);
+    // eventTimeMs is the time of the change in ms since epoch
+    void setCounter(std::size_t value, qint64 eventTimeMs);
     void resetCounter();
 
 private slots:
@@ -25,16 +34,40 @@ private slots:
     void openSerialPort();
     void closeSerialPort();
     void readData();
+    void updateAnalytics();
+    void requestTimeSync();
+    void sendTuning();
 
 private:
-    void processLine(QByteArray const& line);
+    void processLine(char const* line, std::size_t len);
+    void sendMessage(codec::Message const& msg);
+    void requestBackfill();
+    void startBackfill(codec::Message const& msg);
+    [[nodiscard]] auto acceptEventSeq(std::uint32_t seq) -> bool;
+    [[nodiscard]] auto nowMs() const -> qint64 { return mHostEpochMs + mHostClock.elapsed(); }
 
 private:
     Console* mConsole;
     SettingsDialog* mSettings;
     QSerialPort* mSerial = nullptr;
-    QByteArray mRxBuf;
+    codec::LineReader<> mRxLine;
     QLabel* mCounterLabel;
     QLabel* mDeltaLabel;
+    QLabel* mAnalyticsLabel;
     std::size_t mCounterValue;
+    // Set once the count the server's events start from is known: 0 if a backfill covers the whole
+    // server run, otherwise the first count received since startup or a server restart. Only
+    // changes after that are counted as events
+    bool mHasBaseline = false;
+    CountAnalytics mAnalytics;
+    // Host timebase: monotonic ms since startup, reported as ms since epoch through nowMs()
+    QElapsedTimer mHostClock;
+    qint64 mHostEpochMs = 0;
+    ServerClock mServerClock;
+    QTimer* mSyncTimer;
+    // Sequence numbers of the server's count events, used to backfill what was missed while the
+    // port was closed and to drop events that arrive twice
+    std::optional<std::uint32_t> mServerBootId;
+    std::uint32_t mLastSeq = 0;
+    bool mAwaitingBackfill = false;
 };
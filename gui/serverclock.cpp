@@ -0,0 +1,97 @@
+#include "serverclock.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Samples with a round trip time within this factor (plus slack) of the best one are used for the fit
+    constexpr std::int64_t RTT_FACTOR = 2;
+    constexpr std::int64_t RTT_SLACK_MS = 1;
+    // The drift is only estimated once the samples span this long; shorter spans are dominated by jitter
+    constexpr std::int64_t MIN_DRIFT_SPAN_MS = 10'000;
+    // Any real crystal is well within this, larger values mean a bad fit
+    constexpr double MAX_DRIFT = 1000e-6;
+} // namespace
+
+void ServerClock::addSample(std::int64_t hostSendMs, std::uint32_t serverRecvMs, std::uint32_t serverSendMs, std::int64_t hostRecvMs) {
+    // the server's clock only goes backwards if it restarted, its old samples then describe another clock
+    if (mSampleCount > 0 && static_cast<std::int32_t>(serverRecvMs - mLastServerRaw) < 0) {
+        reset();
+    }
+    if (mSampleCount == 0) {
+        mLastServerRaw = serverRecvMs;
+        mLastServerMs = serverRecvMs;
+    }
+    std::int64_t const s1 = unwrap(serverRecvMs);
+    std::int64_t const s2 = s1 + static_cast<std::int32_t>(serverSendMs - serverRecvMs);
+    mLastServerRaw = serverSendMs;
+    mLastServerMs = s2;
+
+    Sample sample;
+    sample.serverMs = (s1 + s2) / 2;
+    sample.offsetMs = (static_cast<double>(hostSendMs - s1) + static_cast<double>(hostRecvMs - s2)) / 2.0;
+    sample.rttMs = std::max<std::int64_t>(0, (hostRecvMs - hostSendMs) - (s2 - s1));
+
+    mSamples[mNextSample] = sample;
+    mNextSample = (mNextSample + 1) % SAMPLE_COUNT;
+    mSampleCount = std::min(mSampleCount + 1, SAMPLE_COUNT);
+    fit();
+}
+
+void ServerClock::reset() {
+    *this = ServerClock{};
+}
+
+auto ServerClock::toHost(std::uint32_t serverMs) const -> std::int64_t {
+    std::int64_t const s = unwrap(serverMs);
+    double const host = static_cast<double>(s) + mOffset + mDrift * static_cast<double>(s - mRefServerMs);
+    return std::llround(host);
+}
+
+auto ServerClock::unwrap(std::uint32_t serverMs) const -> std::int64_t {
+    return mLastServerMs + static_cast<std::int32_t>(serverMs - mLastServerRaw);
+}
+
+void ServerClock::fit() {
+    std::int64_t minRtt = mSamples[0].rttMs;
+    for (std::size_t i = 1; i < mSampleCount; ++i) {
+        minRtt = std::min(minRtt, mSamples[i].rttMs);
+    }
+    std::int64_t const maxRtt = minRtt * RTT_FACTOR + RTT_SLACK_MS;
+
+    // reference point is the newest good sample so extrapolation to new events stays short
+    std::size_t n = 0;
+    mRefServerMs = 0;
+    for (std::size_t i = 0; i < mSampleCount; ++i) {
+        if (mSamples[i].rttMs <= maxRtt) {
+            mRefServerMs = (n == 0) ? mSamples[i].serverMs : std::max(mRefServerMs, mSamples[i].serverMs);
+            ++n;
+        }
+    }
+
+    double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+    std::int64_t minX = 0, maxX = 0;
+    for (std::size_t i = 0; i < mSampleCount; ++i) {
+        Sample const& s = mSamples[i];
+        if (s.rttMs > maxRtt) continue;
+        auto const x = static_cast<double>(s.serverMs - mRefServerMs);
+        sumX += x;
+        sumY += s.offsetMs;
+        sumXX += x * x;
+        sumXY += x * s.offsetMs;
+        minX = std::min(minX, s.serverMs - mRefServerMs);
+        maxX = std::max(maxX, s.serverMs - mRefServerMs);
+    }
+
+    auto const count = static_cast<double>(n);
+    double const denom = count * sumXX - sumX * sumX;
+    if (n >= 2 && maxX - minX >= MIN_DRIFT_SPAN_MS && denom > 0) {
+        mDrift = std::clamp((count * sumXY - sumX * sumY) / denom, -MAX_DRIFT, MAX_DRIFT);
+        mOffset = (sumY - mDrift * sumX) / count;
+    } else {
+        mDrift = 0;
+        mOffset = sumY / count;
+    }
+    mErrorBoundMs = static_cast<double>(minRtt) / 2.0;
+    mSynced = true;
+}
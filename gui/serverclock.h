@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Maps the server's millis() onto the host's monotonic clock.
+//
+// Fed with NTP style exchanges (host send, server receive, server send, host receive).
+// The offset and drift are fitted by least squares over the recent exchanges whose
+// round trip time is close to the best one, since those carry the least queueing delay.
+// A server time earlier than the previous sample means the server restarted and starts a new fit.
+class ServerClock {
+public:
+    static constexpr std::size_t SAMPLE_COUNT = 64;
+
+    void addSample(std::int64_t hostSendMs, std::uint32_t serverRecvMs, std::uint32_t serverSendMs, std::int64_t hostRecvMs);
+    void reset();
+
+    [[nodiscard]] auto isSynced() const -> bool { return mSynced; }
+    // Host time (same clock as the samples) at which the server clock read `serverMs`.
+    [[nodiscard]] auto toHost(std::uint32_t serverMs) const -> std::int64_t;
+    [[nodiscard]] auto driftPpm() const -> double { return mDrift * 1e6; }
+    // Half the best round trip time, i.e. the worst case error of the offset.
+    [[nodiscard]] auto errorBoundMs() const -> double { return mErrorBoundMs; }
+
+private:
+    struct Sample {
+        std::int64_t serverMs = 0; // unwrapped server time at the middle of the exchange
+        double offsetMs = 0;       // host - server
+        std::int64_t rttMs = 0;
+    };
+
+    [[nodiscard]] auto unwrap(std::uint32_t serverMs) const -> std::int64_t;
+    void fit();
+
+    std::array<Sample, SAMPLE_COUNT> mSamples{};
+    std::size_t mSampleCount = 0;
+    std::size_t mNextSample = 0;
+
+    std::uint32_t mLastServerRaw = 0;
+    std::int64_t mLastServerMs = 0;
+
+    bool mSynced = false;
+    std::int64_t mRefServerMs = 0;
+    double mOffset = 0;
+    double mDrift = 0;
+    double mErrorBoundMs = 0;
+};
@@ -5,6 +5,7 @@
 #include <QIntValidator>
 #include <QLineEdit>
 #include <QSerialPortInfo>
+#include <QSpinBox>
 
 static char const BLANK_STRING[] = QT_TRANSLATE_NOOP("SettingsDialog", "N/A");
 
@@ -24,9 +25,13 @@ SettingsDialog::SettingsDialog(QWidget* parent) : QDialog(parent), mUi(new Ui::S
             this, &SettingsDialog::checkCustomBaudRatePolicy);
     connect(mUi->serialPortInfoListBox, QOverload<int>::of(&QComboBox::currentIndexChanged),
             this, &SettingsDialog::checkCustomDevicePathPolicy);
+    mUi->sendTuningButton->setAutoDefault(false);
+    connect(mUi->sendTuningButton, &QPushButton::clicked,
+            this, &SettingsDialog::sendTuningClicked);
 
     fillPortsParameters();
     fillPortsInfo();
+    fillTuningParameters();
 }
 
 SettingsDialog::~SettingsDialog() {
@@ -35,6 +40,20 @@ SettingsDialog::~SettingsDialog() {
 
 [[nodiscard]] auto SettingsDialog::settings() const -> Settings { return mCurrentSettings; }
 
+[[nodiscard]] auto SettingsDialog::tuning() const -> std::array<std::uint32_t, codec::CONFIG_KEY_COUNT> {
+    std::array<std::uint32_t, codec::CONFIG_KEY_COUNT> values{};
+    for (std::size_t i = 0; i < codec::CONFIG_KEY_COUNT; ++i) {
+        values[i] = static_cast<std::uint32_t>(mTuningBoxes[i]->value());
+    }
+    return values;
+}
+
+void SettingsDialog::setTuningValue(std::uint32_t key, std::uint32_t value) {
+    if (key < codec::CONFIG_KEY_COUNT) {
+        mTuningBoxes[key]->setValue(static_cast<int>(value));
+    }
+}
+
 void SettingsDialog::showEvent(QShowEvent* event) {
     QDialog::showEvent(event);
     onShown();
@@ -84,6 +103,8 @@ void SettingsDialog::onShown() {
 }
 
 void SettingsDialog::fillPortsParameters() {
+    // default, esp_server runs its GUI link at this rate
+    mUi->baudRateBox->addItem(QStringLiteral("921600"), 921600);
     mUi->baudRateBox->addItem(QStringLiteral("115200"), QSerialPort::Baud115200);
     mUi->baudRateBox->addItem(QStringLiteral("57600"), QSerialPort::Baud57600);
     mUi->baudRateBox->addItem(QStringLiteral("38400"), QSerialPort::Baud38400);
@@ -95,6 +116,17 @@ void SettingsDialog::fillPortsParameters() {
     mUi->baudRateBox->addItem(tr("Custom"));
 }
 
+void SettingsDialog::fillTuningParameters() {
+    for (std::size_t i = 0; i < codec::CONFIG_KEY_COUNT; ++i) {
+        codec::ConfigSpec const& spec = codec::CONFIG_TABLE[i];
+        auto* box = new QSpinBox(this);
+        box->setRange(static_cast<int>(spec.minValue), static_cast<int>(spec.maxValue));
+        box->setValue(static_cast<int>(spec.defaultValue));
+        mUi->tuningLayout->addRow(tr(spec.name), box);
+        mTuningBoxes[i] = box;
+    }
+}
+
 void SettingsDialog::fillPortsInfo() {
     mUi->serialPortInfoListBox->clear();
     QString const blankString = tr(::BLANK_STRING);
@@ -128,11 +160,11 @@ void SettingsDialog::updateSettings() {
 
     mCurrentSettings.name = mUi->serialPortInfoListBox->currentText();
 
-    if (mUi->baudRateBox->currentIndex() == 4) {
+    auto const baudRateData = mUi->baudRateBox->currentData();
+    if (!baudRateData.isValid()) {
         mCurrentSettings.baudRate = mUi->baudRateBox->currentText().toInt();
     } else {
-        auto const baudRateData = mUi->baudRateBox->currentData();
-        mCurrentSettings.baudRate = baudRateData.value<QSerialPort::BaudRate>();
+        mCurrentSettings.baudRate = baudRateData.toInt();
     }
     mCurrentSettings.stringBaudRate = QString::number(mCurrentSettings.baudRate);
 
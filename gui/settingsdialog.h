@@ -3,12 +3,17 @@
 #include "QDialog"
 #include "QSerialPort"
 
+#include "MessageCodec.h"
+
+#include <array>
+
 QT_BEGIN_NAMESPACE
 namespace Ui {
     class SettingsDialog;
 }
 
 class QIntValidator;
+class QSpinBox;
 QT_END_NAMESPACE
 
 class SettingsDialog : public QDialog {
@@ -31,11 +36,17 @@ public:
     [[nodiscard]] auto settings() const -> Settings;
     [[nodiscard]] auto settingsChangedOnLastApply() const -> bool { return mSettingsChangedOnLastApply; }
 
+    // Runtime settings for the server and stations, indexed by codec::ConfigKey
+    [[nodiscard]] auto tuning() const -> std::array<std::uint32_t, codec::CONFIG_KEY_COUNT>;
+    // Shows the value the server reports it is using
+    void setTuningValue(std::uint32_t key, std::uint32_t value);
+
 protected:
     void showEvent(QShowEvent* event) override;
 
 signals:
     void applyClicked();
+    void sendTuningClicked();
 
 private slots:
     void showPortInfo(int idx);
@@ -47,6 +58,7 @@ private:
     void onShown();
     void fillPortsParameters();
     void fillPortsInfo();
+    void fillTuningParameters();
     void updateSettings();
     void logSettings() const;
 
@@ -54,5 +66,6 @@ private:
     Ui::SettingsDialog* mUi = nullptr;
     Settings mCurrentSettings{};
     QIntValidator* mIntValidator = nullptr;
+    std::array<QSpinBox*, codec::CONFIG_KEY_COUNT> mTuningBoxes{};
     bool mSettingsChangedOnLastApply = false;
 };
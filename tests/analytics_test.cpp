@@ -0,0 +1,122 @@
+// Host tests for gui/countanalytics.h.
+
+#include "countanalytics.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+    int failures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++failures;                                                      \
+        }                                                                    \
+    } while (false)
+
+    constexpr std::int64_t T0 = 1'700'000'000'000; // some epoch time in ms
+    constexpr std::int64_t MINUTE = 60'000;
+
+    auto near(double a, double b) -> bool { return std::fabs(a - b) < 1e-9; }
+
+    auto snapshotAt(CountAnalytics& a, std::int64_t nowMs) -> CountAnalytics::Snapshot {
+        a.advanceTo(nowMs);
+        return a.snapshot(nowMs);
+    }
+
+    // one event per second for 15 minutes: every window sees 60 per minute
+    void steadyRate() {
+        CountAnalytics a;
+        for (std::int64_t s = 0; s < 15 * 60; ++s) a.addEvent(T0 + s * 1000);
+        auto const snap = snapshotAt(a, T0 + 15 * MINUTE - 1);
+        CHECK(near(snap.perMinute[0], 60) && near(snap.perMinute[1], 60) && near(snap.perMinute[2], 60));
+        CHECK(snap.peakPerMinute == 60);
+        CHECK(snap.longestIdleMs == 1000);
+    }
+
+    // windows only average over the time since the first event
+    void partialWindow() {
+        CountAnalytics a;
+        a.addEvent(T0, 10);
+        auto const snap = snapshotAt(a, T0 + 9'999);
+        CHECK(near(snap.perMinute[0], 10 * 60.0 / 10));
+        CHECK(near(snap.perMinute[2], 10 * 60.0 / 10));
+        CHECK(snap.idleMs == 9'999);
+    }
+
+    // history replayed after a reconnect arrives behind newer events and is merged into its bucket
+    void outOfOrderEvents() {
+        CountAnalytics a;
+        a.addEvent(T0 + 30'000);
+        a.addEvent(T0 + 10'000);
+        a.addEvent(T0 + 20'000);
+        auto const snap = snapshotAt(a, T0 + 59'999);
+        CHECK(near(snap.perMinute[0], 3 * 60.0 / 50));
+        // the idle statistics follow the newest event, late ones do not shorten or extend them
+        CHECK(snap.idleMs == 29'999);
+        CHECK(snap.longestIdleMs == 29'999);
+    }
+
+    // events older than the longest window are dropped, the ones inside still count
+    void lateEvents() {
+        CountAnalytics a;
+        a.addEvent(T0 + 20 * MINUTE);
+        a.addEvent(T0 + 20 * MINUTE - 16 * MINUTE);
+        a.addEvent(T0 + 20 * MINUTE - 10 * MINUTE);
+        auto const snap = snapshotAt(a, T0 + 20 * MINUTE + 500);
+        CHECK(near(snap.perMinute[0], 1)); // newest only
+        CHECK(near(snap.perMinute[2], 2 * 60.0 / (10 * 60 + 1)));
+    }
+
+    // counts leave each window as time passes, also across gaps longer than the ring
+    void windowExpiry() {
+        CountAnalytics a;
+        a.addEvent(T0, 5);
+
+        auto snap = snapshotAt(a, T0 + MINUTE + 1000);
+        CHECK(near(snap.perMinute[0], 0));
+        CHECK(snap.perMinute[1] > 0 && snap.perMinute[2] > 0);
+
+        snap = snapshotAt(a, T0 + 5 * MINUTE + 1000);
+        CHECK(near(snap.perMinute[1], 0) && snap.perMinute[2] > 0);
+
+        snap = snapshotAt(a, T0 + 15 * MINUTE + 1000);
+        CHECK(near(snap.perMinute[2], 0));
+        CHECK(snap.peakPerMinute == 5);
+
+        // a gap of hours is skipped in one step, stale buckets must not come back
+        snap = snapshotAt(a, T0 + 180 * MINUTE);
+        CHECK(near(snap.perMinute[0], 0) && near(snap.perMinute[2], 0));
+        a.addEvent(T0 + 180 * MINUTE, 2);
+        snap = snapshotAt(a, T0 + 180 * MINUTE + 500);
+        CHECK(near(snap.perMinute[0], 2 * 60.0 / 60));
+        CHECK(snap.longestIdleMs == 180 * MINUTE);
+    }
+
+    void resetClearsEverything() {
+        CountAnalytics a;
+        a.addEvent(T0, 100);
+        a.reset();
+        auto const snap = snapshotAt(a, T0 + 1000);
+        CHECK(near(snap.perMinute[0], 0) && snap.peakPerMinute == 0 && snap.idleMs == 0);
+    }
+} // namespace
+
+auto main() -> int {
+    steadyRate();
+    partialWindow();
+    outOfOrderEvents();
+    lateEvents();
+    windowExpiry();
+    resetClearsEverything();
+
+    if (failures != 0) {
+        std::printf("%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    std::printf("all checks passed\n");
+    return EXIT_SUCCESS;
+}
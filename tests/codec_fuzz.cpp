@@ -0,0 +1,224 @@
+// Fuzz and throughput test for common/MessageCodec.h.
+//
+// Usage: codec_fuzz [iterations] [seed]
+
+#include "MessageCodec.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    int failures = 0;
+    // number of heap allocations so far, counted by the operator new replacements below
+    std::size_t allocations = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++failures;                                                      \
+        }                                                                    \
+    } while (false)
+
+    auto randomMessage(std::mt19937& rng) -> codec::Message {
+        codec::MsgSpec const& spec = codec::MESSAGE_TABLE[rng() % codec::MESSAGE_TABLE_SIZE];
+        codec::Message msg;
+        msg.type = spec.type;
+        msg.argc = static_cast<std::uint8_t>(spec.minArgs + rng() % (spec.maxArgs - spec.minArgs + 1));
+        for (std::uint8_t i = 0; i < msg.argc; ++i) {
+            // mix small values with full range ones so every digit count shows up
+            msg.args[i] = (rng() % 2 == 0) ? rng() % 1000 : static_cast<std::uint32_t>(rng());
+        }
+        return msg;
+    }
+
+    auto sameMessage(codec::Message const& a, codec::Message const& b) -> bool {
+        if (a.type != b.type || a.argc != b.argc) return false;
+        for (std::uint8_t i = 0; i < a.argc; ++i) {
+            if (a.args[i] != b.args[i]) return false;
+        }
+        return true;
+    }
+
+    // every valid message survives encode -> decode, and encode never writes past cap
+    void fuzzRoundTrip(std::mt19937& rng, std::size_t iterations) {
+        for (std::size_t it = 0; it < iterations; ++it) {
+            codec::Message const msg = randomMessage(rng);
+            char buf[codec::MAX_ENCODED_LEN + 1];
+            buf[codec::MAX_ENCODED_LEN] = 'X';
+            std::size_t const len = codec::encode(msg, buf, codec::MAX_ENCODED_LEN);
+            CHECK(len > 0 && buf[len - 1] == '\n');
+            CHECK(buf[codec::MAX_ENCODED_LEN] == 'X');
+
+            codec::Message decoded;
+            CHECK(codec::decode(buf, len, decoded));
+            CHECK(sameMessage(msg, decoded));
+
+            std::size_t const cap = rng() % len;
+            CHECK(codec::encode(msg, buf, cap) == 0);
+        }
+    }
+
+    // random lines never crash decode; whatever decodes as a message encodes to a line that
+    // decodes to the same message (leading zeros are not preserved)
+    void fuzzDecode(std::mt19937& rng, std::size_t iterations) {
+        static constexpr char ALPHABET[] = "#+-srtTbBcgaE0123456789,\r\n x";
+        for (std::size_t it = 0; it < iterations; ++it) {
+            char line[32];
+            std::size_t const len = rng() % sizeof(line);
+            for (std::size_t i = 0; i < len; ++i) {
+                // raw bytes now and then, the protocol alphabet otherwise
+                line[i] = (rng() % 8 == 0) ? static_cast<char>(rng()) : ALPHABET[rng() % (sizeof(ALPHABET) - 1)];
+            }
+
+            codec::Message decoded;
+            bool const known = codec::decode(line, len, decoded);
+            CHECK(known == (decoded.type != codec::MsgType::Text));
+            if (!known || decoded.type == codec::MsgType::None) continue;
+
+            char buf[codec::MAX_ENCODED_LEN];
+            std::size_t const encodedLen = codec::encode(decoded, buf, sizeof(buf));
+            codec::Message again;
+            CHECK(encodedLen > 0);
+            CHECK(codec::decode(buf, encodedLen, again) && sameMessage(decoded, again));
+        }
+    }
+
+    // a stream of messages, free text and overlong lines cut into random chunks comes out of
+    // LineReader as the same lines, truncated to its buffer size
+    void fuzzLineReader(std::mt19937& rng, std::size_t iterations) {
+        constexpr std::size_t N = 32;
+        for (std::size_t it = 0; it < iterations; ++it) {
+            std::string stream;
+            std::vector<std::string> expected;
+            std::size_t const lines = 1 + rng() % 16;
+            for (std::size_t l = 0; l < lines; ++l) {
+                std::string line;
+                if (rng() % 2 == 0) {
+                    char buf[codec::MAX_ENCODED_LEN];
+                    std::size_t const len = codec::encode(randomMessage(rng), buf, sizeof(buf));
+                    line.assign(buf, len - 1);
+                } else {
+                    std::size_t const len = rng() % (2 * N);
+                    for (std::size_t i = 0; i < len; ++i) {
+                        char c = static_cast<char>(rng());
+                        line += (c == '\n' || c == '\r') ? ' ' : c;
+                    }
+                }
+                stream += line;
+                stream += (rng() % 2 == 0) ? "\r\n" : "\n";
+                expected.push_back(line.substr(0, N));
+            }
+
+            codec::LineReader<N> reader;
+            std::vector<std::string> got;
+            std::size_t pos = 0;
+            while (pos < stream.size()) {
+                std::size_t const chunk = std::min<std::size_t>(stream.size() - pos, rng() % 48);
+                reader.feed(stream.data() + pos, chunk, [&](char const* data, std::size_t len) {
+                    got.emplace_back(data, len);
+                });
+                pos += chunk;
+            }
+            CHECK(got == expected);
+            CHECK(reader.pending() == 0);
+        }
+    }
+
+    void checkEdgeCases() {
+        codec::Message msg;
+        CHECK(codec::decode("", 0, msg) && msg.type == codec::MsgType::None);
+        CHECK(!codec::decode("server started\n", 15, msg) && msg.type == codec::MsgType::Text);
+        CHECK(codec::decode("#4294967295\r\n", 13, msg) && msg.args[0] == 4294967295U);
+        CHECK(!codec::decode("#4294967296", 11, msg));
+        CHECK(!codec::decode("#", 1, msg));
+        CHECK(!codec::decode("#1,", 3, msg));
+        CHECK(!codec::decode("#1,,2", 5, msg));
+        CHECK(!codec::decode("#1,2,3,4", 8, msg));
+        CHECK(!codec::decode("+1", 2, msg));
+        CHECK(codec::encode(codec::Message{codec::MsgType::Text, 0, {}}, nullptr, 0) == 0);
+    }
+
+    // the codec is used once per message on every tier, so encode, decode and LineReader must not
+    // touch the heap at all
+    void checkNoAllocations(std::mt19937& rng) {
+        std::string stream;
+        std::vector<codec::Message> messages;
+        for (std::size_t i = 0; i < 1000; ++i) {
+            messages.push_back(randomMessage(rng));
+            char buf[codec::MAX_ENCODED_LEN];
+            stream.append(buf, codec::encode(messages.back(), buf, sizeof(buf)));
+        }
+
+        std::size_t const before = allocations;
+        char buf[codec::MAX_ENCODED_LEN];
+        std::size_t decoded = 0;
+        for (codec::Message const& msg: messages) {
+            codec::Message out;
+            std::size_t const len = codec::encode(msg, buf, sizeof(buf));
+            decoded += codec::decode(buf, len, out) ? 1 : 0;
+        }
+        codec::LineReader<> reader;
+        std::size_t lines = 0;
+        for (std::size_t pos = 0; pos < stream.size(); pos += 7) {
+            reader.feed(stream.data() + pos, std::min<std::size_t>(7, stream.size() - pos),
+                        [&](char const* line, std::size_t len) {
+                            codec::Message out;
+                            lines += codec::decode(line, len, out) ? 1 : 0;
+                        });
+        }
+        CHECK(allocations == before);
+        CHECK(decoded == messages.size() && lines == messages.size());
+    }
+
+    // encode + decode of a typical count update
+    void measureThroughput(std::size_t messages) {
+        char buf[codec::MAX_ENCODED_LEN];
+        codec::Message msg;
+        std::uint64_t checksum = 0;
+        auto const start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < messages; ++i) {
+            auto const n = static_cast<std::uint32_t>(i);
+            std::size_t const len = codec::encode(codec::make_message(codec::MsgType::SetCount, n, n * 7, n), buf, sizeof(buf));
+            codec::decode(buf, len, msg);
+            checksum += msg.args[0];
+        }
+        std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+        std::printf("throughput: %.1f M messages/s (checksum %llu)\n",
+                    static_cast<double>(messages) / elapsed.count() / 1e6, static_cast<unsigned long long>(checksum));
+    }
+} // namespace
+
+auto operator new(std::size_t size) -> void* {
+    ++allocations;
+    if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+auto main(int argc, char** argv) -> int {
+    std::size_t const iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200'000;
+    auto const seed = static_cast<std::uint32_t>(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1);
+    std::mt19937 rng(seed);
+
+    checkEdgeCases();
+    checkNoAllocations(rng);
+    fuzzRoundTrip(rng, iterations);
+    fuzzDecode(rng, iterations);
+    fuzzLineReader(rng, iterations / 10);
+    measureThroughput(iterations * 10);
+
+    if (failures != 0) {
+        std::printf("%d checks failed (seed %u)\n", failures, seed);
+        return EXIT_FAILURE;
+    }
+    std::printf("all checks passed (seed %u)\n", seed);
+    return EXIT_SUCCESS;
+}
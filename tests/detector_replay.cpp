@@ -0,0 +1,126 @@
+// Replays sample traces through esp_client/CrossingDetector.h in DMA frame sized blocks,
+// checks the number of detected crossings and reports samples/sec.
+//
+// Usage: detector_replay
+//            replays a generated trace (noisy pulses, also inverted) and checks every crossing is found
+//        detector_replay <trace> <on> <off> <filter_shift> <invert> [expected]
+//            replays a recorded trace: raw readings separated by whitespace, '#' starts a comment
+
+#include "AdcSampler.h"
+#include "CrossingDetector.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    // settings from esp_client.ino
+    constexpr std::uint16_t ON_THRESHOLD = 2500;
+    constexpr std::uint16_t OFF_THRESHOLD = 1800;
+    constexpr std::uint8_t FILTER_SHIFT = 3;
+    constexpr std::uint16_t ADC_MAX = 4095;
+
+    struct Trace {
+        std::vector<std::uint16_t> samples;
+        std::uint32_t crossings = 0; // objects that passed
+    };
+
+    struct Result {
+        std::uint32_t crossings = 0;
+        double samplesPerSec = 0;
+    };
+
+    // idle/present stretches of random length, with gaussian noise on both levels
+    auto generateTrace(std::uint32_t objects, std::uint32_t seed) -> Trace {
+        std::mt19937 rng(seed);
+        std::normal_distribution<double> noise(0, 120);
+        Trace trace;
+        auto const push = [&](double level) {
+            double const v = std::clamp(level + noise(rng), 0.0, static_cast<double>(ADC_MAX));
+            trace.samples.push_back(static_cast<std::uint16_t>(v));
+        };
+        for (std::uint32_t i = 0; i < objects; ++i) {
+            for (std::uint32_t n = 200 + rng() % 2000; n > 0; --n) push(1000);
+            for (std::uint32_t n = 50 + rng() % 400; n > 0; --n) push(3300);
+            ++trace.crossings;
+        }
+        for (std::uint32_t n = 500; n > 0; --n) push(1000);
+        return trace;
+    }
+
+    auto loadTrace(char const* path, std::vector<std::uint16_t>& samples) -> bool {
+        std::ifstream in(path);
+        if (!in) return false;
+        std::string token;
+        while (in >> token) {
+            if (token[0] == '#') {
+                std::getline(in, token);
+                continue;
+            }
+            samples.push_back(static_cast<std::uint16_t>(std::strtoul(token.c_str(), nullptr, 10)));
+        }
+        return true;
+    }
+
+    auto replay(std::vector<std::uint16_t> const& samples, std::uint16_t on, std::uint16_t off,
+                std::uint8_t shift, std::uint8_t invert, int repeats) -> Result {
+        Result result;
+        crossing_detector detector;
+        auto const start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; ++r) {
+            crossing_detector_init(&detector, on, off, shift, invert);
+            std::uint32_t crossings = 0;
+            for (std::size_t i = 0; i < samples.size(); i += ADC_SAMPLER_FRAME_SAMPLES) {
+                std::size_t const n = std::min<std::size_t>(ADC_SAMPLER_FRAME_SAMPLES, samples.size() - i);
+                crossings += crossing_detector_process(&detector, &samples[i], n);
+            }
+            result.crossings = crossings;
+        }
+        std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+        result.samplesPerSec = static_cast<double>(samples.size()) * repeats / elapsed.count();
+        return result;
+    }
+
+    auto report(char const* name, Result const& result, long expected) -> bool {
+        std::printf("%s: %u crossings", name, result.crossings);
+        if (expected >= 0) std::printf(" (expected %ld)", expected);
+        std::printf(", %.1f M samples/s\n", result.samplesPerSec / 1e6);
+        return expected < 0 || result.crossings == static_cast<std::uint32_t>(expected);
+    }
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    if (argc > 1) {
+        if (argc < 6) {
+            std::fprintf(stderr, "usage: %s <trace> <on> <off> <filter_shift> <invert> [expected]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        std::vector<std::uint16_t> samples;
+        if (!loadTrace(argv[1], samples)) {
+            std::fprintf(stderr, "cannot read %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+        auto const on = static_cast<std::uint16_t>(std::strtoul(argv[2], nullptr, 10));
+        auto const off = static_cast<std::uint16_t>(std::strtoul(argv[3], nullptr, 10));
+        auto const shift = static_cast<std::uint8_t>(std::strtoul(argv[4], nullptr, 10));
+        auto const invert = static_cast<std::uint8_t>(std::strtoul(argv[5], nullptr, 10));
+        long const expected = argc > 6 ? std::strtol(argv[6], nullptr, 10) : -1;
+        bool const ok = report(argv[1], replay(samples, on, off, shift, invert, 1), expected);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    Trace trace = generateTrace(2000, 2);
+    bool ok = report("generated", replay(trace.samples, ON_THRESHOLD, OFF_THRESHOLD, FILTER_SHIFT, 0, 20), trace.crossings);
+
+    // same trace from a sensor whose reading drops when an object is present
+    for (auto& s: trace.samples) s = static_cast<std::uint16_t>(ADC_MAX - s);
+    ok &= report("generated, inverted",
+                 replay(trace.samples, ADC_MAX - ON_THRESHOLD, ADC_MAX - OFF_THRESHOLD, FILTER_SHIFT, 1, 20), trace.crossings);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
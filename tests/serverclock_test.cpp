@@ -0,0 +1,147 @@
+// Host tests for gui/serverclock.h: simulated NTP style exchanges with a server whose
+// clock has its own offset and drift.
+
+#include "serverclock.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+namespace {
+    int failures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++failures;                                                      \
+        }                                                                    \
+    } while (false)
+
+    // server millis() as a function of host time
+    struct SimServer {
+        std::int64_t bootHostMs = 0; // host time at which the server's millis() was startMs
+        std::uint32_t startMs = 0;
+        double drift = 0; // server ms per host ms - 1
+
+        [[nodiscard]] auto millis(std::int64_t hostMs) const -> std::uint32_t {
+            double const elapsed = static_cast<double>(hostMs - bootHostMs) * (1.0 + drift);
+            return startMs + static_cast<std::uint32_t>(std::llround(elapsed));
+        }
+    };
+
+    // one exchange every 2 s (the GUI's sync interval) with random one-way delays
+    auto exchange(ServerClock& clock, SimServer const& server, std::int64_t hostMs, std::mt19937& rng,
+                  int maxDelayMs = 3) -> std::int64_t {
+        std::int64_t const send = hostMs;
+        std::int64_t const recv = send + static_cast<std::int64_t>(rng() % (maxDelayMs + 1));
+        std::int64_t const reply = recv + static_cast<std::int64_t>(rng() % (maxDelayMs + 1));
+        clock.addSample(send, server.millis(recv), server.millis(recv), reply);
+        return hostMs + 2000;
+    }
+
+    // worst error of toHost() over events in the last sync interval
+    auto maxError(ServerClock const& clock, SimServer const& server, std::int64_t hostMs) -> std::int64_t {
+        std::int64_t worst = 0;
+        for (std::int64_t t = hostMs - 2000; t <= hostMs; t += 100) {
+            worst = std::max(worst, std::abs(clock.toHost(server.millis(t)) - t));
+        }
+        return worst;
+    }
+
+    void offsetOnly() {
+        std::mt19937 rng(1);
+        SimServer const server{50'000, 1234, 0};
+        ServerClock clock;
+        CHECK(!clock.isSynced());
+        std::int64_t host = 60'000;
+        host = exchange(clock, server, host, rng);
+        CHECK(clock.isSynced());
+        CHECK(maxError(clock, server, host) <= 4);
+        CHECK(clock.errorBoundMs() <= 3);
+    }
+
+    // a 200 ppm crystal is off by 24 ms after two minutes, the fit must follow it
+    void driftFit() {
+        std::mt19937 rng(2);
+        SimServer const server{0, 0, 200e-6};
+        ServerClock clock;
+        std::int64_t host = 1000;
+        for (int i = 0; i < 64; ++i) host = exchange(clock, server, host, rng);
+        // driftPpm() is the host - server offset change per server ms, negative for a fast server
+        CHECK(std::fabs(clock.driftPpm() + 200) < 50);
+        CHECK(maxError(clock, server, host) <= 4);
+    }
+
+    // slow exchanges carry queueing delay and are left out of the fit
+    void slowExchangesIgnored() {
+        std::mt19937 rng(3);
+        SimServer const server{0, 777, 0};
+        ServerClock clock;
+        std::int64_t host = 1000;
+        for (int i = 0; i < 32; ++i) {
+            host = exchange(clock, server, host, rng, i % 4 == 0 ? 1 : 0);
+            // reply stuck in a queue for half a second
+            clock.addSample(host, server.millis(host + 1), server.millis(host + 1), host + 500);
+            host += 2000;
+        }
+        CHECK(maxError(clock, server, host) <= 2);
+    }
+
+    // millis() wraps after ~49.7 days; the mapping must carry straight on
+    void millisWrap() {
+        std::mt19937 rng(4);
+        SimServer const server{0, 0xFFFFFFFFU - 30'000, 50e-6};
+        ServerClock clock;
+        std::int64_t host = 0;
+        for (int i = 0; i < 40; ++i) host = exchange(clock, server, host, rng);
+        CHECK(server.millis(host) < 60'000); // wrapped
+        CHECK(maxError(clock, server, host) <= 4);
+        // an event stamped just before the wrap still maps to just before it
+        std::int64_t const before = host - 60'000;
+        CHECK(std::abs(clock.toHost(server.millis(before)) - before) <= 4);
+    }
+
+    // a server that restarts while the port is open starts its millis() over; mixing both
+    // runs put every event minutes in the past until the old samples aged out
+    void serverRestart() {
+        std::mt19937 rng(5);
+        SimServer const first{0, 0, 0};
+        ServerClock clock;
+        std::int64_t host = 1000;
+        for (int i = 0; i < 64; ++i) host = exchange(clock, first, host, rng);
+
+        SimServer const second{host, 0, 0};
+        host += 500;
+        for (int i = 0; i < 5; ++i) {
+            host = exchange(clock, second, host, rng);
+            CHECK(maxError(clock, second, host) <= 4);
+        }
+    }
+
+    void resetForgetsSamples() {
+        std::mt19937 rng(6);
+        SimServer const server{0, 0, 0};
+        ServerClock clock;
+        exchange(clock, server, 1000, rng);
+        clock.reset();
+        CHECK(!clock.isSynced());
+    }
+} // namespace
+
+auto main() -> int {
+    offsetOnly();
+    driftFit();
+    slowExchangesIgnored();
+    millisWrap();
+    serverRestart();
+    resetForgetsSamples();
+
+    if (failures != 0) {
+        std::printf("%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    std::printf("all checks passed\n");
+    return EXIT_SUCCESS;
+}